@@ -27,15 +27,19 @@ static void decrement_counter(struct debounce_state *state, const int elapsed_ms
     }
 }
 
-void debounce_update(struct debounce_state *state, const bool active, const int elapsed_ms,
-                     const struct debounce_config *config) {
+static void flip_state(struct debounce_state *state) {
+    state->pressed = !state->pressed;
+    state->counter = 0;
+    state->changed = true;
+}
+
+static void integrator_update(struct debounce_state *state, const bool active,
+                              const int elapsed_ms, const struct debounce_config *config) {
     // This uses a variation of the integrator debouncing described at
     // https://www.kennethkuhn.com/electronics/debounce.c
     // Every update where "active" does not match the current state, we increment
     // a counter, otherwise we decrement it. When the counter reaches a
     // threshold, the state flips and we reset the counter.
-    state->changed = false;
-
     if (active == state->pressed) {
         decrement_counter(state, elapsed_ms);
         return;
@@ -48,9 +52,84 @@ void debounce_update(struct debounce_state *state, const bool active, const int
         return;
     }
 
-    state->pressed = !state->pressed;
-    state->counter = 0;
-    state->changed = true;
+    flip_state(state);
+}
+
+static void defer_update(struct debounce_state *state, const bool active, const int elapsed_ms,
+                         const struct debounce_config *config) {
+    // Like the integrator, but any bounce back to the latched state restarts the count.
+    if (active == state->pressed) {
+        state->counter = 0;
+        return;
+    }
+
+    if (state->counter < get_threshold(state, config)) {
+        increment_counter(state, elapsed_ms);
+        return;
+    }
+
+    flip_state(state);
+}
+
+static void eager_press_update(struct debounce_state *state, const bool active,
+                               const int elapsed_ms, const struct debounce_config *config) {
+    if (!state->pressed) {
+        // A release is only latched once the switch has stopped bouncing, so the first contact
+        // after it is a real press.
+        if (active) {
+            flip_state(state);
+        }
+        return;
+    }
+
+    defer_update(state, active, elapsed_ms, config);
+}
+
+static void eager_update(struct debounce_state *state, const bool active, const int elapsed_ms,
+                         const struct debounce_config *config) {
+    // The counter holds the time left before the switch may change again.
+    if (state->counter > 0) {
+        decrement_counter(state, elapsed_ms);
+        return;
+    }
+
+    if (active != state->pressed) {
+        flip_state(state);
+        // get_threshold() now returns the time for the opposite change, so look up the new state's
+        // time directly.
+        state->counter = state->pressed ? config->debounce_press_ms : config->debounce_release_ms;
+    }
+}
+
+void debounce_init(struct debounce_state *states, const size_t len,
+                   const struct debounce_config *config) {
+    for (size_t i = 0; i < len; i++) {
+        states[i].algorithm = config->algorithm;
+    }
+}
+
+void debounce_override(struct debounce_state *state, const struct debounce_config *config) {
+    state->algorithm = config->override_algorithm;
+}
+
+void debounce_update(struct debounce_state *state, const bool active, const int elapsed_ms,
+                     const struct debounce_config *config) {
+    state->changed = false;
+
+    switch ((enum debounce_algorithm)state->algorithm) {
+    case DEBOUNCE_INTEGRATOR:
+        integrator_update(state, active, elapsed_ms, config);
+        break;
+    case DEBOUNCE_EAGER_PRESS:
+        eager_press_update(state, active, elapsed_ms, config);
+        break;
+    case DEBOUNCE_EAGER:
+        eager_update(state, active, elapsed_ms, config);
+        break;
+    case DEBOUNCE_DEFER:
+        defer_update(state, active, elapsed_ms, config);
+        break;
+    }
 }
 
 bool debounce_is_active(const struct debounce_state *state) {
@@ -59,4 +138,97 @@ bool debounce_is_active(const struct debounce_state *state) {
 
 bool debounce_is_pressed(const struct debounce_state *state) { return state->pressed; }
 
-bool debounce_get_changed(const struct debounce_state *state) { return state->changed; }
\ No newline at end of file
+bool debounce_get_changed(const struct debounce_state *state) { return state->changed; }
+// The functions below operate on bit-sliced counters: counter[b] is the bit vector of bit b of
+// every switch's counter within one word, for b in [0, DEBOUNCE_COUNTER_BITS).
+
+static uint32_t *counter_plane(const struct debounce_matrix_state *state, const int bit,
+                               const int word) {
+    return &state->counter[bit * state->words + word];
+}
+
+/**
+ * @returns a mask of the switches in a word whose counter is at least threshold.
+ */
+static uint32_t counter_at_least(const struct debounce_matrix_state *state, const int word,
+                                 const uint32_t threshold) {
+    uint32_t greater = 0;
+    uint32_t equal = UINT32_MAX;
+
+    for (int b = DEBOUNCE_COUNTER_BITS - 1; b >= 0; b--) {
+        const uint32_t plane = *counter_plane(state, b, word);
+
+        if (threshold & BIT(b)) {
+            equal &= plane;
+        } else {
+            greater |= equal & plane;
+            equal &= ~plane;
+        }
+    }
+
+    return greater | equal;
+}
+
+void debounce_matrix_update(struct debounce_matrix_state *state, const uint32_t *active,
+                            const int elapsed_ms, const struct debounce_config *config) {
+    // Elapsed times past the counter range saturate every counter they touch.
+    const bool elapsed_overflows = elapsed_ms > DEBOUNCE_COUNTER_MAX;
+
+    for (int w = 0; w < state->words; w++) {
+        const uint32_t pressed = state->pressed[w];
+        const uint32_t mismatch = active[w] ^ pressed;
+
+        // Same integrator as debounce_update(): switches that match their latched state count
+        // down, the others count up until they reach the threshold for their state and flip.
+        const uint32_t reached =
+            (pressed & counter_at_least(state, w, config->debounce_release_ms)) |
+            (~pressed & counter_at_least(state, w, config->debounce_press_ms));
+        const uint32_t flip = mismatch & reached;
+        const uint32_t increment = mismatch & ~reached;
+        const uint32_t decrement = ~mismatch;
+
+        uint32_t carry = 0;
+        uint32_t borrow = 0;
+        uint32_t sum[DEBOUNCE_COUNTER_BITS];
+        uint32_t difference[DEBOUNCE_COUNTER_BITS];
+
+        for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+            const uint32_t plane = *counter_plane(state, b, w);
+            const uint32_t e = (elapsed_ms & BIT(b)) ? UINT32_MAX : 0;
+
+            sum[b] = plane ^ e ^ carry;
+            carry = (plane & e) | (carry & (plane ^ e));
+
+            difference[b] = plane ^ e ^ borrow;
+            borrow = (~plane & e) | (borrow & ~(plane ^ e));
+        }
+
+        const uint32_t overflow = elapsed_overflows ? UINT32_MAX : carry;
+        const uint32_t underflow = elapsed_overflows ? UINT32_MAX : borrow;
+
+        // Flipped switches get neither mask, which resets their counter to zero.
+        for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+            *counter_plane(state, b, w) =
+                (increment & (sum[b] | overflow)) | (decrement & difference[b] & ~underflow);
+        }
+
+        state->pressed[w] = pressed ^ flip;
+        state->changed[w] = flip;
+    }
+}
+
+bool debounce_matrix_is_active(const struct debounce_matrix_state *state) {
+    for (int w = 0; w < state->words; w++) {
+        if (state->pressed[w]) {
+            return true;
+        }
+
+        for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+            if (*counter_plane(state, b, w)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
@@ -7,15 +7,45 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/util.h>
 
-#define DEBOUNCE_COUNTER_BITS 14
+#define DEBOUNCE_ALGORITHM_BITS 2
+#define DEBOUNCE_COUNTER_BITS 12
 #define DEBOUNCE_COUNTER_MAX BIT_MASK(DEBOUNCE_COUNTER_BITS)
 
+/**
+ * Debounce algorithms. The order must match the debounce-algorithm enum in the kscan devicetree
+ * bindings.
+ */
+enum debounce_algorithm {
+    /**
+     * Count up while the switch differs from its latched state and down while it matches. Latch
+     * once the count reaches the press/release time.
+     */
+    DEBOUNCE_INTEGRATOR,
+    /**
+     * Latch presses immediately. Latch releases once the switch has been released for the release
+     * time without interruption.
+     */
+    DEBOUNCE_EAGER_PRESS,
+    /**
+     * Latch every change immediately, then ignore the switch for the press/release time.
+     */
+    DEBOUNCE_EAGER,
+    /**
+     * Latch a change once the switch has held the new state for the press/release time without
+     * interruption.
+     */
+    DEBOUNCE_DEFER,
+};
+
 struct debounce_state {
     bool pressed : 1;
     bool changed : 1;
+    /** enum debounce_algorithm used for this switch. */
+    uint16_t algorithm : DEBOUNCE_ALGORITHM_BITS;
     uint16_t counter : DEBOUNCE_COUNTER_BITS;
 };
 
@@ -24,8 +54,27 @@ struct debounce_config {
     uint32_t debounce_press_ms;
     /** Duration a switch must be released to latch as released. */
     uint32_t debounce_release_ms;
+    /** Algorithm used by default. */
+    enum debounce_algorithm algorithm;
+    /** Algorithm used by switches passed to debounce_override(). */
+    enum debounce_algorithm override_algorithm;
 };
 
+/**
+ * Sets every switch to use the default debounce algorithm.
+ *
+ * @param states Array of the states for every switch handled by the driver.
+ * @param len Length of states.
+ * @param config Debounce settings.
+ */
+void debounce_init(struct debounce_state *states, const size_t len,
+                   const struct debounce_config *config);
+
+/**
+ * Sets one switch to use the override debounce algorithm instead of the default one.
+ */
+void debounce_override(struct debounce_state *state, const struct debounce_config *config);
+
 /**
  * Debounces one switch.
  *
@@ -54,3 +103,40 @@ bool debounce_is_pressed(const struct debounce_state *state);
  * debounce_update.
  */
 bool debounce_get_changed(const struct debounce_state *state);
+
+/** Number of 32-bit words needed to hold one bit per switch. */
+#define DEBOUNCE_MATRIX_WORDS(switches) DIV_ROUND_UP(switches, 32)
+
+/**
+ * Debounce state for a whole set of switches, stored as bit vectors with one bit per switch. The
+ * counters are bit-sliced: counter[b * words + w] holds bit b of the counters for the switches in
+ * word w, so every switch is updated with a handful of word-wide operations.
+ */
+struct debounce_matrix_state {
+    /** Number of 32-bit words in each bit vector. */
+    size_t words;
+    /** Bit vector of switches latched as pressed. */
+    uint32_t *pressed;
+    /** Bit vector of switches whose pressed state changed in the last update. */
+    uint32_t *changed;
+    /** DEBOUNCE_COUNTER_BITS bit vectors, least significant bit first. */
+    uint32_t *counter;
+};
+
+/**
+ * Debounces every switch in a matrix. This has the same semantics as calling debounce_update()
+ * for each switch using DEBOUNCE_INTEGRATOR. Other algorithms are not supported.
+ *
+ * @param state The state for the switches to debounce.
+ * @param active Bit vector of the switches which are currently pressed.
+ * @param elapsed_ms Time elapsed since the previous update in milliseconds.
+ * @param config Debounce settings.
+ */
+void debounce_matrix_update(struct debounce_matrix_state *state, const uint32_t *active,
+                            const int elapsed_ms, const struct debounce_config *config);
+
+/**
+ * @returns whether any switch is either latched as pressed or is potentially
+ * pressed but the debouncer has not yet made a decision.
+ */
+bool debounce_matrix_is_active(const struct debounce_matrix_state *state);
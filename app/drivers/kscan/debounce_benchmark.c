@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "debounce.h"
+
+#include <string.h>
+
+#include <init.h>
+#include <kernel.h>
+#include <logging/log.h>
+#include <sys/util.h>
+
+#include <zmk/benchmark.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#define BENCHMARK_MAX_SWITCHES 128
+#define BENCHMARK_WORDS DEBOUNCE_MATRIX_WORDS(BENCHMARK_MAX_SWITCHES)
+#define BENCHMARK_TRACE_LEN 64
+#define BENCHMARK_SCANS 2000
+#define BENCHMARK_SCAN_PERIOD_MS 1
+#define EQUIVALENCE_TRACES 64
+#define EQUIVALENCE_SCANS 500
+
+static const struct debounce_config benchmark_config = {
+    .debounce_press_ms = 5,
+    .debounce_release_ms = 5,
+};
+
+// Raw switch readings for each scan of the trace, one bit per switch
+static uint32_t trace[BENCHMARK_TRACE_LEN][BENCHMARK_WORDS];
+
+static struct debounce_state key_states[BENCHMARK_MAX_SWITCHES];
+
+static uint32_t matrix_pressed[BENCHMARK_WORDS];
+static uint32_t matrix_changed[BENCHMARK_WORDS];
+static uint32_t matrix_counter[BENCHMARK_WORDS * DEBOUNCE_COUNTER_BITS];
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1664525 + 1013904223;
+    return *seed >> 16;
+}
+
+/**
+ * Fill the trace with switches that are pressed and released at different rates and bounce
+ * randomly for a few scans after every transition.
+ */
+static void build_trace(const int switches) {
+    uint32_t seed = 1;
+
+    memset(trace, 0, sizeof(trace));
+
+    for (int sw = 0; sw < switches; sw++) {
+        const int period = 8 + sw % 24;
+
+        for (int scan = 0; scan < BENCHMARK_TRACE_LEN; scan++) {
+            bool active = ((scan + sw) / period) % 2;
+
+            if ((scan + sw) % period < 3) {
+                active = next_random(&seed) & 1;
+            }
+
+            WRITE_BIT(trace[scan][sw / 32], sw % 32, active);
+        }
+    }
+}
+
+static uint32_t run_per_key(const int switches, int *changes) {
+    memset(key_states, 0, sizeof(key_states));
+    *changes = 0;
+
+    const uint32_t start = zmk_benchmark_start();
+
+    for (int scan = 0; scan < BENCHMARK_SCANS; scan++) {
+        const uint32_t *active = trace[scan % BENCHMARK_TRACE_LEN];
+
+        for (int sw = 0; sw < switches; sw++) {
+            debounce_update(&key_states[sw], (active[sw / 32] & BIT(sw % 32)) != 0,
+                            BENCHMARK_SCAN_PERIOD_MS, &benchmark_config);
+        }
+
+        for (int sw = 0; sw < switches; sw++) {
+            if (debounce_get_changed(&key_states[sw])) {
+                (*changes)++;
+            }
+        }
+    }
+
+    return zmk_benchmark_ns(start, BENCHMARK_SCANS);
+}
+
+static uint32_t run_bit_parallel(const int switches, int *changes) {
+    struct debounce_matrix_state state = {
+        .words = DEBOUNCE_MATRIX_WORDS(switches),
+        .pressed = matrix_pressed,
+        .changed = matrix_changed,
+        .counter = matrix_counter,
+    };
+
+    memset(matrix_pressed, 0, sizeof(matrix_pressed));
+    memset(matrix_counter, 0, sizeof(matrix_counter));
+    *changes = 0;
+
+    const uint32_t start = zmk_benchmark_start();
+
+    for (int scan = 0; scan < BENCHMARK_SCANS; scan++) {
+        debounce_matrix_update(&state, trace[scan % BENCHMARK_TRACE_LEN], BENCHMARK_SCAN_PERIOD_MS,
+                               &benchmark_config);
+
+        for (int w = 0; w < state.words; w++) {
+            for (uint32_t changed = state.changed[w]; changed; changed &= changed - 1) {
+                (*changes)++;
+            }
+        }
+    }
+
+    return zmk_benchmark_ns(start, BENCHMARK_SCANS);
+}
+
+/**
+ * Run both debouncers over random traces, each with random debounce times, scan period and bounce
+ * rate, and check that they agree on every switch after every scan.
+ */
+static void check_equivalence(const char *name, const int switches) {
+    uint32_t seed = 1;
+    uint32_t active[BENCHMARK_WORDS];
+    struct debounce_matrix_state state = {
+        .words = DEBOUNCE_MATRIX_WORDS(switches),
+        .pressed = matrix_pressed,
+        .changed = matrix_changed,
+        .counter = matrix_counter,
+    };
+
+    for (int t = 0; t < EQUIVALENCE_TRACES; t++) {
+        const struct debounce_config config = {
+            .debounce_press_ms = next_random(&seed) % 31,
+            .debounce_release_ms = next_random(&seed) % 31,
+        };
+        const int scan_period_ms = 1 + next_random(&seed) % 4;
+        const int flip_rate = 2 + next_random(&seed) % 31;
+
+        memset(active, 0, sizeof(active));
+        memset(key_states, 0, sizeof(key_states));
+        memset(matrix_pressed, 0, sizeof(matrix_pressed));
+        memset(matrix_counter, 0, sizeof(matrix_counter));
+
+        for (int scan = 0; scan < EQUIVALENCE_SCANS; scan++) {
+            for (int sw = 0; sw < switches; sw++) {
+                if (next_random(&seed) % flip_rate == 0) {
+                    active[sw / 32] ^= BIT(sw % 32);
+                }
+            }
+
+            debounce_matrix_update(&state, active, scan_period_ms, &config);
+
+            for (int sw = 0; sw < switches; sw++) {
+                debounce_update(&key_states[sw], (active[sw / 32] & BIT(sw % 32)) != 0,
+                                scan_period_ms, &config);
+
+                const bool pressed = (matrix_pressed[sw / 32] & BIT(sw % 32)) != 0;
+                const bool changed = (matrix_changed[sw / 32] & BIT(sw % 32)) != 0;
+
+                if (pressed != debounce_is_pressed(&key_states[sw]) ||
+                    changed != debounce_get_changed(&key_states[sw])) {
+                    LOG_ERR("%s: debouncers disagree on switch %d in scan %d of trace %d", name,
+                            sw, scan, t);
+                    return;
+                }
+            }
+        }
+    }
+
+    LOG_INF("%s: debouncers agree on %d random traces", name, EQUIVALENCE_TRACES);
+}
+
+static void run_benchmark(const char *name, const int switches) {
+    int per_key_changes, bit_parallel_changes;
+
+    build_trace(switches);
+
+    const uint32_t per_key_ns = run_per_key(switches, &per_key_changes);
+    const uint32_t bit_parallel_ns = run_bit_parallel(switches, &bit_parallel_changes);
+
+    if (per_key_changes != bit_parallel_changes) {
+        LOG_ERR("%s: per-key debouncer saw %d changes, bit-parallel saw %d", name,
+                per_key_changes, bit_parallel_changes);
+        return;
+    }
+
+    for (int sw = 0; sw < switches; sw++) {
+        const bool pressed = (matrix_pressed[sw / 32] & BIT(sw % 32)) != 0;
+
+        if (pressed != debounce_is_pressed(&key_states[sw])) {
+            LOG_ERR("%s: debouncers disagree on switch %d", name, sw);
+            return;
+        }
+    }
+
+    LOG_INF("%s: %d scans, %d changes, per-key %u ns/scan, bit-parallel %u ns/scan", name,
+            BENCHMARK_SCANS, per_key_changes, per_key_ns, bit_parallel_ns);
+}
+
+static int debounce_benchmark_init(const struct device *_arg) {
+    check_equivalence("6x14", 6 * 14);
+    check_equivalence("128 keys", 128);
+
+    run_benchmark("6x14", 6 * 14);
+    run_benchmark("128 keys", 128);
+
+    return 0;
+}
+
+SYS_INIT(debounce_benchmark_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -10,6 +10,8 @@
 #include <drivers/kscan.h>
 #include <drivers/gpio.h>
 #include <logging/log.h>
+#include <zmk/kscan.h>
+#include <zmk/workqueue.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -93,7 +95,7 @@ struct kscan_gpio_item_config {
     static void kscan_gpio_timer_handler(struct k_timer *timer) {                                  \
         struct kscan_gpio_data_##n *data =                                                         \
             CONTAINER_OF(timer, struct kscan_gpio_data_##n, poll_timer);                           \
-        k_work_submit(&data->work.work);                                                           \
+        k_work_submit_to_queue(zmk_input_work_q(), &data->work.work);                              \
     }                                                                                              \
                                                                                                    \
     /* Read the state of the input GPIOs */                                                        \
@@ -123,6 +125,8 @@ struct kscan_gpio_item_config {
                 read_state[i][o] = gpio_pin_get(in_dev, in_cfg->pin) > 0;                          \
             }                                                                                      \
         }                                                                                          \
+        /* Report all changes found by this scan as one batch */                                   \
+        zmk_kscan_begin_batch(k_uptime_get());                                                     \
         for (int r = 0; r < INST_MATRIX_INPUTS(n); r++) {                                          \
             for (int c = 0; c < INST_MATRIX_OUTPUTS(n); c++) {                                     \
                 bool pressed = read_state[r][c];                                                   \
@@ -134,9 +138,11 @@ struct kscan_gpio_item_config {
                 }                                                                                  \
             }                                                                                      \
         }                                                                                          \
+        zmk_kscan_end_batch();                                                                     \
         if (submit_follow_up_read) {                                                               \
-            CHECK_DEBOUNCE_CFG(n, ({ k_work_submit(&data->work); }),                               \
-                               ({ k_work_reschedule(&data->work, K_MSEC(5)); }))                   \
+            CHECK_DEBOUNCE_CFG(                                                                    \
+                n, ({ k_work_submit_to_queue(zmk_input_work_q(), &data->work); }),                 \
+                ({ k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_MSEC(5)); }))    \
         }                                                                                          \
         return 0;                                                                                  \
     }                                                                                              \
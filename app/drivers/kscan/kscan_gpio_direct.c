@@ -13,6 +13,8 @@
 #include <kernel.h>
 #include <logging/log.h>
 #include <sys/util.h>
+#include <zmk/kscan.h>
+#include <zmk/workqueue.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -32,6 +34,12 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
     DT_INST_PROP_OR(n, debounce_period, DT_INST_PROP(n, debounce_release_ms))
 #endif
 
+#define INST_DEBOUNCE_ALGORITHM(n) DT_INST_ENUM_IDX(n, debounce_algorithm)
+#define INST_DEBOUNCE_OVERRIDE_ALGORITHM(n) DT_INST_ENUM_IDX(n, debounce_override_algorithm)
+#define INST_DEBOUNCE_OVERRIDE_LEN(n) DT_INST_PROP_LEN_OR(n, debounce_override_keys, 0)
+#define COND_DEBOUNCE_OVERRIDE(n, code, else_code)                                                 \
+    COND_CODE_1(DT_INST_NODE_HAS_PROP(n, debounce_override_keys), code, else_code)
+
 #define USE_POLLING IS_ENABLED(CONFIG_ZMK_KSCAN_DIRECT_POLLING)
 #define USE_INTERRUPTS (!USE_POLLING)
 
@@ -74,6 +82,9 @@ struct kscan_gpio_list {
 struct kscan_direct_config {
     struct kscan_gpio_list inputs;
     struct debounce_config debounce_config;
+    /** Indices of the inputs which use the override debounce algorithm. */
+    const uint8_t *debounce_override_keys;
+    size_t debounce_override_keys_len;
     int32_t debounce_scan_period_ms;
     int32_t poll_period_ms;
     bool toggle_mode;
@@ -121,7 +132,7 @@ static void kscan_direct_irq_callback_handler(const struct device *port, struct
 
     data->scan_time = k_uptime_get();
 
-    k_work_reschedule(&data->work, K_NO_WAIT);
+    k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_NO_WAIT);
 }
 #endif
 
@@ -156,7 +167,7 @@ static void kscan_direct_read_continue(const struct device *dev) {
 
     data->scan_time += config->debounce_scan_period_ms;
 
-    k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+    k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_TIMEOUT_ABS_MS(data->scan_time));
 }
 
 static void kscan_direct_read_end(const struct device *dev) {
@@ -170,7 +181,7 @@ static void kscan_direct_read_end(const struct device *dev) {
     data->scan_time += config->poll_period_ms;
 
     // Return to polling slowly.
-    k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+    k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_TIMEOUT_ABS_MS(data->scan_time));
 #endif
 }
 
@@ -191,6 +202,8 @@ static int kscan_direct_read(const struct device *dev) {
     // Process the new state.
     bool continue_scan = false;
 
+    zmk_kscan_begin_batch(data->scan_time);
+
     for (int i = 0; i < config->inputs.len; i++) {
         struct debounce_state *state = &data->pin_state[i];
 
@@ -207,6 +220,8 @@ static int kscan_direct_read(const struct device *dev) {
         continue_scan = continue_scan || debounce_is_active(state);
     }
 
+    zmk_kscan_end_batch();
+
     if (continue_scan) {
         // At least one key is pressed or the debouncer has not yet decided if
         // it is pressed. Poll quickly until everything is released.
@@ -302,12 +317,31 @@ static int kscan_direct_init_inputs(const struct device *dev) {
     return 0;
 }
 
+static void kscan_direct_init_debounce(const struct device *dev) {
+    const struct kscan_direct_config *config = dev->config;
+    struct kscan_direct_data *data = dev->data;
+
+    debounce_init(data->pin_state, config->inputs.len, &config->debounce_config);
+
+    for (int i = 0; i < config->debounce_override_keys_len; i++) {
+        const int index = config->debounce_override_keys[i];
+
+        if (index >= config->inputs.len) {
+            LOG_ERR("Invalid debounce override key %i", index);
+            continue;
+        }
+
+        debounce_override(&data->pin_state[index], &config->debounce_config);
+    }
+}
+
 static int kscan_direct_init(const struct device *dev) {
     struct kscan_direct_data *data = dev->data;
 
     data->dev = dev;
 
     kscan_direct_init_inputs(dev);
+    kscan_direct_init_debounce(dev);
 
     k_work_init_delayable(&data->work, kscan_direct_work_handler);
 
@@ -326,6 +360,11 @@ static const struct kscan_driver_api kscan_direct_api = {
     BUILD_ASSERT(INST_DEBOUNCE_RELEASE_MS(n) <= DEBOUNCE_COUNTER_MAX,                              \
                  "ZMK_KSCAN_DEBOUNCE_RELEASE_MS or debounce-release-ms is too large");             \
                                                                                                    \
+    COND_DEBOUNCE_OVERRIDE(n,                                                                      \
+                           (static const uint8_t kscan_direct_debounce_override_##n[] =            \
+                                DT_INST_PROP(n, debounce_override_keys);),                         \
+                           ())                                                                     \
+                                                                                                   \
     static const struct gpio_dt_spec kscan_direct_inputs_##n[] = {                                 \
         UTIL_LISTIFY(INST_INPUTS_LEN(n), KSCAN_DIRECT_INPUT_CFG_INIT, n)};                         \
                                                                                                    \
@@ -343,7 +382,12 @@ static const struct kscan_driver_api kscan_direct_api = {
             {                                                                                      \
                 .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(n),                                    \
                 .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(n),                                \
+                .algorithm = INST_DEBOUNCE_ALGORITHM(n),                                           \
+                .override_algorithm = INST_DEBOUNCE_OVERRIDE_ALGORITHM(n),                         \
             },                                                                                     \
+        .debounce_override_keys =                                                                  \
+            COND_DEBOUNCE_OVERRIDE(n, (kscan_direct_debounce_override_##n), (NULL)),               \
+        .debounce_override_keys_len = INST_DEBOUNCE_OVERRIDE_LEN(n),                               \
         .debounce_scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                       \
         .poll_period_ms = DT_INST_PROP(n, poll_period_ms),                                         \
         .toggle_mode = DT_INST_PROP(n, toggle_mode),                                               \
@@ -14,6 +14,8 @@
 #include <logging/log.h>
 #include <sys/__assert.h>
 #include <sys/util.h>
+#include <zmk/kscan.h>
+#include <zmk/workqueue.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -27,6 +29,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #define INST_COLS_LEN(n) DT_INST_PROP_LEN(n, col_gpios)
 #define INST_MATRIX_LEN(n) (INST_ROWS_LEN(n) * INST_COLS_LEN(n))
 #define INST_INPUTS_LEN(n) COND_DIODE_DIR(n, (INST_COLS_LEN(n)), (INST_ROWS_LEN(n)))
+#define INST_OUTPUTS_LEN(n) COND_DIODE_DIR(n, (INST_ROWS_LEN(n)), (INST_COLS_LEN(n)))
 
 #if CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS >= 0
 #define INST_DEBOUNCE_PRESS_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS
@@ -42,10 +45,24 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
     DT_INST_PROP_OR(n, debounce_period, DT_INST_PROP(n, debounce_release_ms))
 #endif
 
+#define INST_DEBOUNCE_ALGORITHM(n) DT_INST_ENUM_IDX(n, debounce_algorithm)
+#define INST_DEBOUNCE_OVERRIDE_ALGORITHM(n) DT_INST_ENUM_IDX(n, debounce_override_algorithm)
+#define INST_DEBOUNCE_OVERRIDE_LEN(n) DT_INST_PROP_LEN_OR(n, debounce_override_keys, 0)
+#define COND_DEBOUNCE_OVERRIDE(n, code, else_code)                                                 \
+    COND_CODE_1(DT_INST_NODE_HAS_PROP(n, debounce_override_keys), code, else_code)
+
 #define USE_POLLING IS_ENABLED(CONFIG_ZMK_KSCAN_MATRIX_POLLING)
 #define USE_INTERRUPTS (!USE_POLLING)
 
+#define USE_PORT_READ IS_ENABLED(CONFIG_ZMK_KSCAN_MATRIX_PORT_READ)
+
 #define COND_INTERRUPTS(code) COND_CODE_1(CONFIG_ZMK_KSCAN_MATRIX_POLLING, (), code)
+#define COND_PORT_READ(code) COND_CODE_1(CONFIG_ZMK_KSCAN_MATRIX_PORT_READ, code, ())
+
+#define USE_BIT_PARALLEL IS_ENABLED(CONFIG_ZMK_KSCAN_MATRIX_DEBOUNCE_BIT_PARALLEL)
+
+#define COND_BIT_PARALLEL(bitcode, keycode)                                                        \
+    COND_CODE_1(CONFIG_ZMK_KSCAN_MATRIX_DEBOUNCE_BIT_PARALLEL, bitcode, keycode)
 #define COND_POLL_OR_INTERRUPTS(pollcode, intcode)                                                 \
     COND_CODE_1(CONFIG_ZMK_KSCAN_MATRIX_POLLING, pollcode, intcode)
 
@@ -64,6 +81,23 @@ struct kscan_matrix_irq_callback {
     struct gpio_callback callback;
 };
 
+#if USE_PORT_READ
+struct kscan_gpio_port {
+    const struct device *port;
+    /** Pins of this port that belong to the list. */
+    gpio_port_pins_t mask;
+};
+
+/** The distinct GPIO ports used by a kscan_gpio_list, built at init. */
+struct kscan_gpio_port_list {
+    /** Array of up to the length of the GPIO list. */
+    struct kscan_gpio_port *ports;
+    size_t len;
+    /** Index into ports of each pin in the GPIO list. */
+    uint8_t *pin_ports;
+};
+#endif
+
 struct kscan_matrix_data {
     const struct device *dev;
     kscan_callback_t callback;
@@ -74,11 +108,27 @@ struct kscan_matrix_data {
 #endif
     /** Timestamp of the current or scheduled scan. */
     int64_t scan_time;
+#if USE_BIT_PARALLEL
+    /**
+     * Current state of the matrix as bit vectors, indexed like the flattened 2D array of length
+     * (config->rows.len * config->cols.len)
+     */
+    struct debounce_matrix_state matrix_bits;
+    /** Bit vector of the switches read as active during the current scan. */
+    uint32_t *active_bits;
+#else
     /**
      * Current state of the matrix as a flattened 2D array of length
      * (config->rows.len * config->cols.len)
      */
     struct debounce_state *matrix_state;
+#endif
+#if USE_PORT_READ
+    struct kscan_gpio_port_list input_ports;
+    struct kscan_gpio_port_list output_ports;
+    /** Value of each input port as of the last read, indexed like input_ports.ports. */
+    gpio_port_value_t *input_values;
+#endif
 };
 
 struct kscan_gpio_list {
@@ -96,6 +146,9 @@ struct kscan_matrix_config {
     struct kscan_gpio_list inputs;
     struct kscan_gpio_list outputs;
     struct debounce_config debounce_config;
+    /** Row and column pairs of the keys which use the override debounce algorithm. */
+    const uint8_t *debounce_override_keys;
+    size_t debounce_override_keys_len;
     int32_t debounce_scan_period_ms;
     int32_t poll_period_ms;
     enum kscan_diode_direction diode_direction;
@@ -121,7 +174,71 @@ static int state_index_io(const struct kscan_matrix_config *config, const int in
                : state_index_rc(config, input_idx, output_idx);
 }
 
+#if USE_PORT_READ
+static void kscan_gpio_port_list_init(struct kscan_gpio_port_list *list,
+                                      const struct kscan_gpio_list *gpios) {
+    list->len = 0;
+
+    for (int i = 0; i < gpios->len; i++) {
+        const struct gpio_dt_spec *gpio = &gpios->gpios[i];
+
+        int p = 0;
+        while (p < list->len && list->ports[p].port != gpio->port) {
+            p++;
+        }
+
+        if (p == list->len) {
+            list->ports[p] = (struct kscan_gpio_port){.port = gpio->port, .mask = 0};
+            list->len++;
+        }
+
+        list->ports[p].mask |= BIT(gpio->pin);
+        list->pin_ports[i] = p;
+    }
+}
+
+/**
+ * Read every input port once. Use kscan_matrix_input_active() to get the state of each input.
+ */
+static int kscan_matrix_read_input_ports(const struct device *dev) {
+    struct kscan_matrix_data *data = dev->data;
+
+    for (int p = 0; p < data->input_ports.len; p++) {
+        const struct kscan_gpio_port *port = &data->input_ports.ports[p];
+
+        int err = gpio_port_get(port->port, &data->input_values[p]);
+        if (err) {
+            LOG_ERR("Failed to read port %s: %i", port->port->name, err);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+static bool kscan_matrix_input_active(const struct device *dev, const int input_idx) {
+    const struct kscan_matrix_config *config = dev->config;
+    const struct kscan_matrix_data *data = dev->data;
+    const gpio_port_value_t value = data->input_values[data->input_ports.pin_ports[input_idx]];
+
+    return (value & BIT(config->inputs.gpios[input_idx].pin)) != 0;
+}
+#endif
+
 static int kscan_matrix_set_all_outputs(const struct device *dev, const int value) {
+#if USE_PORT_READ
+    struct kscan_matrix_data *data = dev->data;
+
+    for (int p = 0; p < data->output_ports.len; p++) {
+        const struct kscan_gpio_port *port = &data->output_ports.ports[p];
+
+        int err = gpio_port_set_masked(port->port, port->mask, value ? port->mask : 0);
+        if (err) {
+            LOG_ERR("Failed to set outputs on port %s to %i: %i", port->port->name, value, err);
+            return err;
+        }
+    }
+#else
     const struct kscan_matrix_config *config = dev->config;
 
     for (int i = 0; i < config->outputs.len; i++) {
@@ -133,6 +250,7 @@ static int kscan_matrix_set_all_outputs(const struct device *dev, const int valu
             return err;
         }
     }
+#endif
 
     return 0;
 }
@@ -193,7 +311,7 @@ static void kscan_matrix_irq_callback_handler(const struct device *port, struct
 
     data->scan_time = k_uptime_get();
 
-    k_work_reschedule(&data->work, K_NO_WAIT);
+    k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_NO_WAIT);
 }
 #endif
 
@@ -203,7 +321,7 @@ static void kscan_matrix_read_continue(const struct device *dev) {
 
     data->scan_time += config->debounce_scan_period_ms;
 
-    k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+    k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_TIMEOUT_ABS_MS(data->scan_time));
 }
 
 static void kscan_matrix_read_end(const struct device *dev) {
@@ -217,7 +335,7 @@ static void kscan_matrix_read_end(const struct device *dev) {
     data->scan_time += config->poll_period_ms;
 
     // Return to polling slowly.
-    k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+    k_work_reschedule_for_queue(zmk_input_work_q(), &data->work, K_TIMEOUT_ABS_MS(data->scan_time));
 #endif
 }
 
@@ -239,14 +357,27 @@ static int kscan_matrix_read(const struct device *dev) {
         k_busy_wait(CONFIG_ZMK_KSCAN_MATRIX_WAIT_BEFORE_INPUTS);
 #endif
 
-        for (int i = 0; i < config->inputs.len; i++) {
-            const struct gpio_dt_spec *in_gpio = &config->inputs.gpios[i];
+#if USE_PORT_READ
+        err = kscan_matrix_read_input_ports(dev);
+        if (err) {
+            return err;
+        }
+#endif
 
+        for (int i = 0; i < config->inputs.len; i++) {
             const int index = state_index_io(config, i, o);
-            const bool active = gpio_pin_get_dt(in_gpio);
+#if USE_PORT_READ
+            const bool active = kscan_matrix_input_active(dev, i);
+#else
+            const bool active = gpio_pin_get_dt(&config->inputs.gpios[i]);
+#endif
 
+#if USE_BIT_PARALLEL
+            WRITE_BIT(data->active_bits[index / 32], index % 32, active);
+#else
             debounce_update(&data->matrix_state[index], active, config->debounce_scan_period_ms,
                             &config->debounce_config);
+#endif
         }
 
         err = gpio_pin_set_dt(out_gpio, 0);
@@ -263,6 +394,32 @@ static int kscan_matrix_read(const struct device *dev) {
     }
 
     // Process the new state.
+    zmk_kscan_begin_batch(data->scan_time);
+
+#if USE_BIT_PARALLEL
+    debounce_matrix_update(&data->matrix_bits, data->active_bits, config->debounce_scan_period_ms,
+                           &config->debounce_config);
+
+    for (int w = 0; w < data->matrix_bits.words; w++) {
+        uint32_t changed = data->matrix_bits.changed[w];
+
+        while (changed) {
+            const int bit = __builtin_ctz(changed);
+            const int index = w * 32 + bit;
+            // Inverse of state_index_rc()
+            const int r = index % config->rows.len;
+            const int c = index / config->rows.len;
+            const bool pressed = (data->matrix_bits.pressed[w] & BIT(bit)) != 0;
+
+            LOG_DBG("Sending event at %i,%i state %s", r, c, pressed ? "on" : "off");
+            data->callback(dev, r, c, pressed);
+
+            changed &= changed - 1;
+        }
+    }
+
+    const bool continue_scan = debounce_matrix_is_active(&data->matrix_bits);
+#else
     bool continue_scan = false;
 
     for (int r = 0; r < config->rows.len; r++) {
@@ -280,6 +437,9 @@ static int kscan_matrix_read(const struct device *dev) {
             continue_scan = continue_scan || debounce_is_active(state);
         }
     }
+#endif
+
+    zmk_kscan_end_batch();
 
     if (continue_scan) {
         // At least one key is pressed or the debouncer has not yet decided if
@@ -408,6 +568,29 @@ static int kscan_matrix_init_outputs(const struct device *dev) {
     return 0;
 }
 
+#if !USE_BIT_PARALLEL
+static void kscan_matrix_init_debounce(const struct device *dev) {
+    const struct kscan_matrix_config *config = dev->config;
+    struct kscan_matrix_data *data = dev->data;
+
+    debounce_init(data->matrix_state, config->rows.len * config->cols.len,
+                  &config->debounce_config);
+
+    for (int i = 0; i + 1 < config->debounce_override_keys_len; i += 2) {
+        const int row = config->debounce_override_keys[i];
+        const int col = config->debounce_override_keys[i + 1];
+
+        if (row >= config->rows.len || col >= config->cols.len) {
+            LOG_ERR("Invalid debounce override key %i,%i", row, col);
+            continue;
+        }
+
+        debounce_override(&data->matrix_state[state_index_rc(config, row, col)],
+                          &config->debounce_config);
+    }
+}
+#endif
+
 static int kscan_matrix_init(const struct device *dev) {
     struct kscan_matrix_data *data = dev->data;
 
@@ -415,6 +598,16 @@ static int kscan_matrix_init(const struct device *dev) {
 
     kscan_matrix_init_inputs(dev);
     kscan_matrix_init_outputs(dev);
+#if !USE_BIT_PARALLEL
+    kscan_matrix_init_debounce(dev);
+#endif
+
+#if USE_PORT_READ
+    const struct kscan_matrix_config *config = dev->config;
+
+    kscan_gpio_port_list_init(&data->input_ports, &config->inputs);
+    kscan_gpio_port_list_init(&data->output_ports, &config->outputs);
+#endif
     kscan_matrix_set_all_outputs(dev, 0);
 
     k_work_init_delayable(&data->work, kscan_matrix_work_handler);
@@ -433,6 +626,16 @@ static const struct kscan_driver_api kscan_matrix_api = {
                  "ZMK_KSCAN_DEBOUNCE_PRESS_MS or debounce-press-ms is too large");                 \
     BUILD_ASSERT(INST_DEBOUNCE_RELEASE_MS(n) <= DEBOUNCE_COUNTER_MAX,                              \
                  "ZMK_KSCAN_DEBOUNCE_RELEASE_MS or debounce-release-ms is too large");             \
+    BUILD_ASSERT(INST_DEBOUNCE_OVERRIDE_LEN(n) % 2 == 0,                                           \
+                 "debounce-override-keys must be a list of row and column pairs");                 \
+    BUILD_ASSERT(!USE_BIT_PARALLEL || (INST_DEBOUNCE_ALGORITHM(n) == DEBOUNCE_INTEGRATOR &&        \
+                                       INST_DEBOUNCE_OVERRIDE_LEN(n) == 0),                        \
+                 "ZMK_KSCAN_MATRIX_DEBOUNCE_BIT_PARALLEL only supports the integrator algorithm"); \
+                                                                                                   \
+    COND_DEBOUNCE_OVERRIDE(n,                                                                      \
+                           (static const uint8_t kscan_matrix_debounce_override_##n[] =            \
+                                DT_INST_PROP(n, debounce_override_keys);),                         \
+                           ())                                                                     \
                                                                                                    \
     static const struct gpio_dt_spec kscan_matrix_rows_##n[] = {                                   \
         UTIL_LISTIFY(INST_ROWS_LEN(n), KSCAN_GPIO_ROW_CFG_INIT, n)};                               \
@@ -440,14 +643,41 @@ static const struct kscan_driver_api kscan_matrix_api = {
     static const struct gpio_dt_spec kscan_matrix_cols_##n[] = {                                   \
         UTIL_LISTIFY(INST_COLS_LEN(n), KSCAN_GPIO_COL_CFG_INIT, n)};                               \
                                                                                                    \
-    static struct debounce_state kscan_matrix_state_##n[INST_MATRIX_LEN(n)];                       \
+    COND_BIT_PARALLEL(                                                                             \
+        (static uint32_t kscan_matrix_pressed_##n[DEBOUNCE_MATRIX_WORDS(INST_MATRIX_LEN(n))];      \
+         static uint32_t kscan_matrix_changed_##n[DEBOUNCE_MATRIX_WORDS(INST_MATRIX_LEN(n))];      \
+         static uint32_t kscan_matrix_counter_##n[DEBOUNCE_MATRIX_WORDS(INST_MATRIX_LEN(n)) *      \
+                                                  DEBOUNCE_COUNTER_BITS];                          \
+         static uint32_t kscan_matrix_active_##n[DEBOUNCE_MATRIX_WORDS(INST_MATRIX_LEN(n))];),     \
+        (static struct debounce_state kscan_matrix_state_##n[INST_MATRIX_LEN(n)];))                \
                                                                                                    \
     COND_INTERRUPTS(                                                                               \
         (static struct kscan_matrix_irq_callback kscan_matrix_irqs_##n[INST_INPUTS_LEN(n)];))      \
                                                                                                    \
+    COND_PORT_READ(                                                                                \
+        (static struct kscan_gpio_port kscan_matrix_input_ports_##n[INST_INPUTS_LEN(n)];           \
+         static struct kscan_gpio_port kscan_matrix_output_ports_##n[INST_OUTPUTS_LEN(n)];         \
+         static uint8_t kscan_matrix_input_pin_ports_##n[INST_INPUTS_LEN(n)];                      \
+         static uint8_t kscan_matrix_output_pin_ports_##n[INST_OUTPUTS_LEN(n)];                    \
+         static gpio_port_value_t kscan_matrix_input_values_##n[INST_INPUTS_LEN(n)];))             \
+                                                                                                   \
     static struct kscan_matrix_data kscan_matrix_data_##n = {                                      \
-        .matrix_state = kscan_matrix_state_##n,                                                    \
-        COND_INTERRUPTS((.irqs = kscan_matrix_irqs_##n, ))};                                       \
+        COND_BIT_PARALLEL(                                                                         \
+            (.matrix_bits =                                                                        \
+                 {                                                                                 \
+                     .words = DEBOUNCE_MATRIX_WORDS(INST_MATRIX_LEN(n)),                           \
+                     .pressed = kscan_matrix_pressed_##n,                                          \
+                     .changed = kscan_matrix_changed_##n,                                          \
+                     .counter = kscan_matrix_counter_##n,                                          \
+                 },                                                                                \
+             .active_bits = kscan_matrix_active_##n, ),                                            \
+            (.matrix_state = kscan_matrix_state_##n, ))                                            \
+        COND_INTERRUPTS((.irqs = kscan_matrix_irqs_##n, ))                                         \
+        COND_PORT_READ((.input_ports = {.ports = kscan_matrix_input_ports_##n,                     \
+                                        .pin_ports = kscan_matrix_input_pin_ports_##n},            \
+                        .output_ports = {.ports = kscan_matrix_output_ports_##n,                   \
+                                         .pin_ports = kscan_matrix_output_pin_ports_##n},          \
+                        .input_values = kscan_matrix_input_values_##n, ))};                        \
                                                                                                    \
     static struct kscan_matrix_config kscan_matrix_config_##n = {                                  \
         .rows = KSCAN_GPIO_LIST(kscan_matrix_rows_##n),                                            \
@@ -460,7 +690,12 @@ static const struct kscan_driver_api kscan_matrix_api = {
             {                                                                                      \
                 .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(n),                                    \
                 .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(n),                                \
+                .algorithm = INST_DEBOUNCE_ALGORITHM(n),                                           \
+                .override_algorithm = INST_DEBOUNCE_OVERRIDE_ALGORITHM(n),                         \
             },                                                                                     \
+        .debounce_override_keys =                                                                  \
+            COND_DEBOUNCE_OVERRIDE(n, (kscan_matrix_debounce_override_##n), (NULL)),               \
+        .debounce_override_keys_len = INST_DEBOUNCE_OVERRIDE_LEN(n),                               \
         .debounce_scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                       \
         .poll_period_ms = DT_INST_PROP(n, poll_period_ms),                                         \
         .diode_direction = INST_DIODE_DIR(n),                                                      \
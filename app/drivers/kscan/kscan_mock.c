@@ -6,23 +6,174 @@
 
 #define DT_DRV_COMPAT zmk_kscan_mock
 
+#include "debounce.h"
+
 #include <stdlib.h>
 #include <device.h>
 #include <drivers/kscan.h>
 #include <logging/log.h>
+#include <zmk/kscan.h>
+#include <zmk/event_manager.h>
+#include <zmk/deadline.h>
+#include <zmk/workqueue.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <dt-bindings/zmk/kscan_mock.h>
 
+// Logs the event pool statistics and the event trace when they are enabled, so tests can check
+// them, and flushes the log before exiting.
+static void kscan_mock_exit(void) {
+    LOG_DBG("Exiting");
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+    zmk_event_manager_log_pool_stats();
+#endif
+#if IS_ENABLED(CONFIG_ZMK_EVENT_TRACE)
+    zmk_event_trace_log();
+#endif
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL) || IS_ENABLED(CONFIG_ZMK_EVENT_TRACE)
+    LOG_PANIC();
+#endif
+    exit(0);
+}
+
+#define INST_DEBOUNCE_LEN(n) (DT_INST_PROP(n, rows) * DT_INST_PROP(n, columns))
+#define INST_DEBOUNCE_OVERRIDE_LEN(n) DT_INST_PROP_LEN_OR(n, debounce_override_keys, 0)
+#define COND_DEBOUNCE(n, code, else_code)                                                          \
+    COND_CODE_1(DT_INST_NODE_HAS_PROP(n, debounce_algorithm), code, else_code)
+#define COND_DEBOUNCE_OVERRIDE(n, code, else_code)                                                 \
+    COND_CODE_1(DT_INST_NODE_HAS_PROP(n, debounce_override_keys), code, else_code)
+
+#define COND_BLOCK_SYSTEM_WORK_Q(n, code)                                                          \
+    COND_CODE_1(DT_INST_NODE_HAS_PROP(n, block_system_work_queue_ms), code, ())
+
+#define MOCK_INST_HAS_DEBOUNCE(n) DT_INST_NODE_HAS_PROP(n, debounce_algorithm) ||
+#define USE_DEBOUNCE (DT_INST_FOREACH_STATUS_OKAY(MOCK_INST_HAS_DEBOUNCE) 0)
+
 struct kscan_mock_data {
     kscan_callback_t callback;
 
     uint32_t event_index;
     struct k_work_delayable work;
     const struct device *dev;
+
+    /** Time at which the scheduled event is due when not debouncing. */
+    int64_t event_due;
+
+    /** Trace time of the current scan when debouncing. */
+    uint32_t scan_time;
+    /** Trace time of the event at event_index when debouncing. */
+    uint32_t event_time;
+    /** Whether any key was pressed or still debouncing as of the last scan. */
+    bool debounce_active;
 };
 
+#if IS_ENABLED(CONFIG_ZMK_DEADLINE_MOCK_CLOCK)
+/*
+ * With the mock clock, time only moves forward when the mock reaches its next event or scan, so
+ * there is no reason to wait for it in real time.
+ */
+#define KSCAN_MOCK_DELAY(ms) K_NO_WAIT
+#else
+#define KSCAN_MOCK_DELAY(ms) K_MSEC(ms)
+#endif
+
+/**
+ * Start a scan or event which is due at the given time. With the mock clock, the clock first moves
+ * to that time, running every deadline that is due by then. Otherwise the current uptime is used.
+ */
+static void kscan_mock_begin_batch(int64_t due) {
+#if IS_ENABLED(CONFIG_ZMK_DEADLINE_MOCK_CLOCK)
+    zmk_deadline_advance(due);
+    zmk_kscan_begin_batch(due);
+#else
+    zmk_kscan_begin_batch(k_uptime_get());
+#endif
+}
+
+#if USE_DEBOUNCE
+/**
+ * When a mock has a debounce-algorithm, its events are raw switch readings instead of key events.
+ * The mock then scans like a kscan GPIO driver, feeding the readings through the debouncer and
+ * reporting the debounced changes.
+ */
+struct kscan_mock_debounce_config {
+    struct debounce_config config;
+    int32_t scan_period_ms;
+    uint32_t rows;
+    uint32_t columns;
+    /** Row and column pairs of the keys which use the override debounce algorithm. */
+    const uint8_t *override_keys;
+    size_t override_keys_len;
+    /** Current raw state of each key as a flattened array of length (rows * columns). */
+    bool *active;
+    /** Debounce state of each key as a flattened array of length (rows * columns). */
+    struct debounce_state *state;
+};
+
+static int kscan_mock_debounce_index(const struct kscan_mock_debounce_config *debounce,
+                                     const int row, const int col) {
+    return (row * debounce->columns) + col;
+}
+
+static void kscan_mock_debounce_init(const struct kscan_mock_debounce_config *debounce) {
+    debounce_init(debounce->state, debounce->rows * debounce->columns, &debounce->config);
+
+    for (int i = 0; i + 1 < debounce->override_keys_len; i += 2) {
+        const int row = debounce->override_keys[i];
+        const int col = debounce->override_keys[i + 1];
+
+        if (row >= debounce->rows || col >= debounce->columns) {
+            LOG_ERR("Invalid debounce override key %i,%i", row, col);
+            continue;
+        }
+
+        debounce_override(&debounce->state[kscan_mock_debounce_index(debounce, row, col)],
+                          &debounce->config);
+    }
+}
+
+static void kscan_mock_debounce_set(const struct kscan_mock_debounce_config *debounce,
+                                    const uint32_t ev) {
+    const int index = kscan_mock_debounce_index(debounce, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev));
+
+    debounce->active[index] = ZMK_MOCK_IS_PRESS(ev);
+}
+
+static bool kscan_mock_debounce_scan(const struct device *dev,
+                                     const struct kscan_mock_debounce_config *debounce,
+                                     const uint32_t time) {
+    struct kscan_mock_data *data = dev->data;
+    bool active = false;
+
+    kscan_mock_begin_batch(time);
+
+    for (int r = 0; r < debounce->rows; r++) {
+        for (int c = 0; c < debounce->columns; c++) {
+            const int index = kscan_mock_debounce_index(debounce, r, c);
+            struct debounce_state *state = &debounce->state[index];
+
+            debounce_update(state, debounce->active[index], debounce->scan_period_ms,
+                            &debounce->config);
+
+            if (debounce_get_changed(state)) {
+                const bool pressed = debounce_is_pressed(state);
+
+                LOG_DBG("%u ms: row %d column %d %s", time, r, c,
+                        pressed ? "pressed" : "released");
+                data->callback(dev, r, c, pressed);
+            }
+
+            active = active || debounce_is_active(state);
+        }
+    }
+
+    zmk_kscan_end_batch();
+
+    return active;
+}
+#endif
+
 static int kscan_mock_disable_callback(const struct device *dev) {
     struct kscan_mock_data *data = dev->data;
 
@@ -43,10 +194,77 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
     return 0;
 }
 
+#define MOCK_INST_DEBOUNCE_INIT(n)                                                                 \
+    static void kscan_mock_debounce_start_##n(const struct device *dev) {                          \
+        struct kscan_mock_data *data = dev->data;                                                  \
+        const struct kscan_mock_config_##n *cfg = dev->config;                                     \
+        data->scan_time = 0;                                                                       \
+        data->event_time = ZMK_MOCK_MSEC(cfg->events[0]);                                          \
+        data->debounce_active = false;                                                             \
+        k_work_schedule_for_queue(zmk_input_work_q(), &data->work, K_NO_WAIT);                     \
+    }                                                                                              \
+    static void kscan_mock_debounce_work_handler_##n(struct k_work *work) {                        \
+        struct kscan_mock_data *data = CONTAINER_OF(work, struct kscan_mock_data, work);           \
+        const struct kscan_mock_config_##n *cfg = data->dev->config;                               \
+        if (data->event_index >= DT_INST_PROP_LEN(n, events) && !data->debounce_active) {          \
+            if (cfg->exit_after) {                                                                 \
+                kscan_mock_exit();                                                                 \
+            }                                                                                      \
+            return;                                                                                \
+        }                                                                                          \
+        while (data->event_index < DT_INST_PROP_LEN(n, events) &&                                  \
+               data->event_time <= data->scan_time) {                                              \
+            kscan_mock_debounce_set(&cfg->debounce, cfg->events[data->event_index]);               \
+            data->event_index++;                                                                   \
+            if (data->event_index < DT_INST_PROP_LEN(n, events)) {                                 \
+                data->event_time += ZMK_MOCK_MSEC(cfg->events[data->event_index]);                 \
+            }                                                                                      \
+        }                                                                                          \
+        data->debounce_active = kscan_mock_debounce_scan(data->dev, &cfg->debounce,                \
+                                                         data->scan_time);                         \
+        data->scan_time += cfg->debounce.scan_period_ms;                                           \
+        k_work_schedule_for_queue(zmk_input_work_q(), &data->work,                                 \
+                                  KSCAN_MOCK_DELAY(cfg->debounce.scan_period_ms));                 \
+    }
+
+#define MOCK_INST_DEBOUNCE_CONFIG(n)                                                               \
+    {                                                                                              \
+        .config =                                                                                  \
+            {                                                                                      \
+                .debounce_press_ms = DT_INST_PROP(n, debounce_press_ms),                           \
+                .debounce_release_ms = DT_INST_PROP(n, debounce_release_ms),                       \
+                .algorithm = DT_INST_ENUM_IDX(n, debounce_algorithm),                              \
+                .override_algorithm = DT_INST_ENUM_IDX(n, debounce_override_algorithm),            \
+            },                                                                                     \
+        .scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                                \
+        .rows = DT_INST_PROP(n, rows), .columns = DT_INST_PROP(n, columns),                        \
+        .override_keys = COND_DEBOUNCE_OVERRIDE(n, (kscan_mock_debounce_override_##n), (NULL)),    \
+        .override_keys_len = INST_DEBOUNCE_OVERRIDE_LEN(n),                                        \
+        .active = kscan_mock_active_##n, .state = kscan_mock_state_##n,                            \
+    }
+
+#define MOCK_INST_DEBOUNCE_STATE(n)                                                                \
+    static bool kscan_mock_active_##n[INST_DEBOUNCE_LEN(n)];                                       \
+    static struct debounce_state kscan_mock_state_##n[INST_DEBOUNCE_LEN(n)];                       \
+    COND_DEBOUNCE_OVERRIDE(n,                                                                      \
+                           (static const uint8_t kscan_mock_debounce_override_##n[] =              \
+                                DT_INST_PROP(n, debounce_override_keys);),                         \
+                           ())
+
+#define MOCK_INST_BLOCK_SYSTEM_WORK_Q(n)                                                           \
+    static void kscan_mock_block_system_work_q_##n(struct k_work *work) {                          \
+        LOG_DBG("Blocking the system work queue for %d ms",                                        \
+                DT_INST_PROP(n, block_system_work_queue_ms));                                      \
+        k_msleep(DT_INST_PROP(n, block_system_work_queue_ms));                                     \
+    }                                                                                              \
+    static K_WORK_DEFINE(kscan_mock_block_work_##n, kscan_mock_block_system_work_q_##n);
+
 #define MOCK_INST_INIT(n)                                                                          \
+    COND_DEBOUNCE(n, (MOCK_INST_DEBOUNCE_STATE(n)), ())                                            \
     struct kscan_mock_config_##n {                                                                 \
         uint32_t events[DT_INST_PROP_LEN(n, events)];                                              \
         bool exit_after;                                                                           \
+        COND_DEBOUNCE(n, (struct kscan_mock_debounce_config debounce;), ())                        \
     };                                                                                             \
     static void kscan_mock_schedule_next_event_##n(const struct device *dev) {                     \
         struct kscan_mock_data *data = dev->data;                                                  \
@@ -54,30 +272,46 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
         if (data->event_index < DT_INST_PROP_LEN(n, events)) {                                     \
             uint32_t ev = cfg->events[data->event_index];                                          \
             LOG_DBG("delaying next keypress: %d", ZMK_MOCK_MSEC(ev));                              \
-            k_work_schedule(&data->work, K_MSEC(ZMK_MOCK_MSEC(ev)));                               \
+            data->event_due =                                                                      \
+                COND_CODE_1(CONFIG_ZMK_DEADLINE_MOCK_CLOCK, (data->event_due), (k_uptime_get())) + \
+                ZMK_MOCK_MSEC(ev);                                                                 \
+            k_work_schedule_for_queue(zmk_input_work_q(), &data->work,                             \
+                                      KSCAN_MOCK_DELAY(ZMK_MOCK_MSEC(ev)));                        \
         } else if (cfg->exit_after) {                                                              \
-            LOG_DBG("Exiting");                                                                    \
-            exit(0);                                                                               \
+            kscan_mock_exit();                                                                     \
         }                                                                                          \
     }                                                                                              \
     static void kscan_mock_work_handler_##n(struct k_work *work) {                                 \
         struct kscan_mock_data *data = CONTAINER_OF(work, struct kscan_mock_data, work);           \
         const struct kscan_mock_config_##n *cfg = data->dev->config;                               \
         uint32_t ev = cfg->events[data->event_index];                                              \
+        COND_CODE_1(CONFIG_ZMK_DEADLINE_MOCK_CLOCK, (),                                            \
+                    (LOG_DBG("event is %lld ms late", k_uptime_get() - data->event_due);))         \
         LOG_DBG("ev %u row %d column %d state %d\n", ev, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev),       \
                 ZMK_MOCK_IS_PRESS(ev));                                                            \
+        kscan_mock_begin_batch(data->event_due);                                                   \
         data->callback(data->dev, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev), ZMK_MOCK_IS_PRESS(ev));      \
+        zmk_kscan_end_batch();                                                                     \
         kscan_mock_schedule_next_event_##n(data->dev);                                             \
         data->event_index++;                                                                       \
     }                                                                                              \
+    COND_DEBOUNCE(n, (MOCK_INST_DEBOUNCE_INIT(n)), ())                                             \
     static int kscan_mock_init_##n(const struct device *dev) {                                     \
         struct kscan_mock_data *data = dev->data;                                                  \
         data->dev = dev;                                                                           \
-        k_work_init_delayable(&data->work, kscan_mock_work_handler_##n);                           \
+        COND_DEBOUNCE(                                                                             \
+            n,                                                                                     \
+            (kscan_mock_debounce_init(&((const struct kscan_mock_config_##n *)dev->config)         \
+                                           ->debounce);                                            \
+             k_work_init_delayable(&data->work, kscan_mock_debounce_work_handler_##n);),           \
+            (k_work_init_delayable(&data->work, kscan_mock_work_handler_##n);))                    \
         return 0;                                                                                  \
     }                                                                                              \
+    COND_BLOCK_SYSTEM_WORK_Q(n, (MOCK_INST_BLOCK_SYSTEM_WORK_Q(n)))                                \
     static int kscan_mock_enable_callback_##n(const struct device *dev) {                          \
-        kscan_mock_schedule_next_event_##n(dev);                                                   \
+        COND_BLOCK_SYSTEM_WORK_Q(n, (k_work_submit(&kscan_mock_block_work_##n);))                  \
+        COND_DEBOUNCE(n, (kscan_mock_debounce_start_##n(dev);),                                    \
+                      (kscan_mock_schedule_next_event_##n(dev);))                                  \
         return 0;                                                                                  \
     }                                                                                              \
     static const struct kscan_driver_api mock_driver_api_##n = {                                   \
@@ -87,7 +321,9 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
     };                                                                                             \
     static struct kscan_mock_data kscan_mock_data_##n;                                             \
     static const struct kscan_mock_config_##n kscan_mock_config_##n = {                            \
-        .events = DT_INST_PROP(n, events), .exit_after = DT_INST_PROP(n, exit_after)};             \
+        .events = DT_INST_PROP(n, events),                                                         \
+        .exit_after = DT_INST_PROP(n, exit_after),                                                 \
+        COND_DEBOUNCE(n, (.debounce = MOCK_INST_DEBOUNCE_CONFIG(n), ), ())};                       \
     DEVICE_DT_INST_DEFINE(n, kscan_mock_init_##n, NULL, &kscan_mock_data_##n,                      \
                           &kscan_mock_config_##n, APPLICATION,                                     \
                           CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &mock_driver_api_##n);
@@ -11,6 +11,7 @@
 #include <sys/util.h>
 #include <kernel.h>
 #include <drivers/sensor.h>
+#include <zmk/workqueue.h>
 
 #include "ec11.h"
 
@@ -47,7 +48,7 @@ static void ec11_a_gpio_callback(const struct device *dev, struct gpio_callback
 #if defined(CONFIG_EC11_TRIGGER_OWN_THREAD)
     k_sem_give(&drv_data->gpio_sem);
 #elif defined(CONFIG_EC11_TRIGGER_GLOBAL_THREAD)
-    k_work_submit(&drv_data->work);
+    k_work_submit_to_queue(zmk_input_work_q(), &drv_data->work);
 #endif
 }
 
@@ -62,7 +63,7 @@ static void ec11_b_gpio_callback(const struct device *dev, struct gpio_callback
 #if defined(CONFIG_EC11_TRIGGER_OWN_THREAD)
     k_sem_give(&drv_data->gpio_sem);
 #elif defined(CONFIG_EC11_TRIGGER_GLOBAL_THREAD)
-    k_work_submit(&drv_data->work);
+    k_work_submit_to_queue(zmk_input_work_q(), &drv_data->work);
 #endif
 }
 
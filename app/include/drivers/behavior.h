@@ -45,6 +45,21 @@ __subsystem struct behavior_driver_api {
  * @endcond
  */
 
+/**
+ * @brief Get the behavior device of a binding, looking it up by name only the first time
+ * @param binding Pointer to the binding, which caches the resolved device
+ *
+ * @retval Pointer to the behavior device, or NULL if no such behavior exists.
+ */
+static inline const struct device *
+behavior_get_binding_device(struct zmk_behavior_binding *binding) {
+    if (binding->behavior == NULL) {
+        binding->behavior = device_get_binding(binding->behavior_dev);
+    }
+
+    return binding->behavior;
+}
+
 /**
  * @brief Handle the keymap binding which needs to be converted from relative "toggle" to absolute
  * "turn on"
@@ -59,7 +74,7 @@ __syscall int behavior_keymap_binding_convert_central_state_dependent_params(
 
 static inline int z_impl_behavior_keymap_binding_convert_central_state_dependent_params(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
     const struct behavior_driver_api *api = (const struct behavior_driver_api *)dev->api;
 
     if (api->binding_convert_central_state_dependent_params == NULL) {
@@ -105,7 +120,7 @@ __syscall int behavior_keymap_binding_pressed(struct zmk_behavior_binding *bindi
 
 static inline int z_impl_behavior_keymap_binding_pressed(struct zmk_behavior_binding *binding,
                                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
@@ -133,7 +148,7 @@ __syscall int behavior_keymap_binding_released(struct zmk_behavior_binding *bind
 
 static inline int z_impl_behavior_keymap_binding_released(struct zmk_behavior_binding *binding,
                                                           struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
@@ -165,7 +180,7 @@ __syscall int behavior_sensor_keymap_binding_triggered(struct zmk_behavior_bindi
 static inline int
 z_impl_behavior_sensor_keymap_binding_triggered(struct zmk_behavior_binding *binding,
                                                 const struct device *sensor, int64_t timestamp) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
 
     if (dev == NULL) {
         return -EINVAL;
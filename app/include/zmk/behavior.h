@@ -9,8 +9,12 @@
 #define ZMK_BEHAVIOR_OPAQUE 0
 #define ZMK_BEHAVIOR_TRANSPARENT 1
 
+struct device;
+
 struct zmk_behavior_binding {
     char *behavior_dev;
+    // Device named by behavior_dev, resolved once so invoking the binding needs no name lookup
+    const struct device *behavior;
     uint32_t param1;
     uint32_t param2;
 };
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <kernel.h>
+
+// Number of rounds a benchmark averages each timing over, unless it needs its own count
+#define ZMK_BENCHMARK_ROUNDS 1000
+
+/**
+ * Timing for the optional boot-time benchmarks that native_posix tests enable. Take the start
+ * with zmk_benchmark_start() before running a code path a number of times, then get the average
+ * nanoseconds per round from zmk_benchmark_ns().
+ */
+static inline uint32_t zmk_benchmark_start(void) { return k_cycle_get_32(); }
+
+static inline uint32_t zmk_benchmark_ns(uint32_t start, uint32_t rounds) {
+    return (uint32_t)(k_cyc_to_ns_floor64(k_cycle_get_32() - start) / rounds);
+}
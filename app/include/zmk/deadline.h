@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <kernel.h>
+#include <sys/dlist.h>
+
+struct zmk_deadline;
+
+typedef void (*zmk_deadline_handler_t)(struct zmk_deadline *deadline);
+
+/**
+ * A timeout for a behavior or other key processing state. All deadlines share one kernel timer on
+ * the input work queue, which runs each handler once its deadline has passed.
+ *
+ * Deadlines are only scheduled, cancelled and handled on the input work queue, so a cancelled
+ * deadline never runs its handler afterwards.
+ */
+struct zmk_deadline {
+    sys_dnode_t node;
+    // Uptime in milliseconds at which the handler runs
+    int64_t at;
+    zmk_deadline_handler_t handler;
+};
+
+#define ZMK_DEADLINE_INITIALIZER(_handler)                                                         \
+    { .handler = _handler }
+
+void zmk_deadline_init(struct zmk_deadline *deadline, zmk_deadline_handler_t handler);
+
+/**
+ * Run the handler once the uptime reaches at, replacing any earlier schedule of this deadline.
+ * Deadlines that are due at the same time run in the order they were scheduled.
+ */
+void zmk_deadline_schedule(struct zmk_deadline *deadline, int64_t at);
+
+void zmk_deadline_cancel(struct zmk_deadline *deadline);
+
+static inline bool zmk_deadline_is_scheduled(const struct zmk_deadline *deadline) {
+    return sys_dnode_is_linked(&deadline->node);
+}
+
+/**
+ * Current time in milliseconds as seen by deadlines. This is the uptime, or the mock clock with
+ * CONFIG_ZMK_DEADLINE_MOCK_CLOCK.
+ */
+int64_t zmk_deadline_now(void);
+
+#if IS_ENABLED(CONFIG_ZMK_DEADLINE_MOCK_CLOCK)
+/**
+ * Move the mock clock forward to the given time, running the handlers of all deadlines due by
+ * then in order. Each handler sees the mock clock at its own deadline.
+ */
+void zmk_deadline_advance(int64_t to);
+#endif
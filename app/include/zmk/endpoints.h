@@ -6,11 +6,19 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <zmk/endpoints_types.h>
 
+struct zmk_endpoints_report_stats {
+    uint32_t sent;
+    uint32_t suppressed;
+};
+
 int zmk_endpoints_select(enum zmk_endpoint endpoint);
 int zmk_endpoints_toggle();
 enum zmk_endpoint zmk_endpoints_selected();
 bool zmk_endpoints_preferred_is_active();
 
 int zmk_endpoints_send_report(uint16_t usage_page);
+void zmk_endpoints_get_report_stats(struct zmk_endpoints_report_stats *stats);
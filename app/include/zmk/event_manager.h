@@ -10,12 +10,36 @@
 #include <kernel.h>
 #include <zephyr/types.h>
 
+struct zmk_event_subscription;
+
+struct zmk_event_pool_stats {
+    uint32_t size;
+    uint32_t used;
+    uint32_t high_water;
+    uint32_t exhausted;
+};
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+struct zmk_event_pool {
+    struct k_mem_slab *slab;
+    atomic_t high_water;
+    atomic_t exhausted;
+};
+#endif
+
 struct zmk_event_type {
     const char *name;
+    // Bounds of this event type's listeners, grouped contiguously at link time
+    const struct zmk_event_subscription *subscriptions_start;
+    const struct zmk_event_subscription *subscriptions_end;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+    struct zmk_event_pool *pool;
+#endif
 };
 
 typedef struct {
     const struct zmk_event_type *event;
+    // Index of the last listener invoked, relative to the event type's subscriptions
     uint8_t last_listener_index;
 } zmk_event_t;
 
@@ -26,6 +50,9 @@ typedef struct {
 typedef int (*zmk_listener_callback_t)(const zmk_event_t *eh);
 struct zmk_listener {
     zmk_listener_callback_t callback;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_TRACE)
+    const char *name;
+#endif
 };
 
 struct zmk_event_subscription {
@@ -42,14 +69,56 @@ struct zmk_event_subscription {
     struct event_type *as_##event_type(const zmk_event_t *eh);                                     \
     extern const struct zmk_event_type zmk_event_##event_type;
 
+/*
+ * Subscriptions are placed in per event type input sections, which the linker sorts by name. The
+ * ".0" and ".2" marker sections bracket the ".1" subscriptions of each event type, so dispatch
+ * only visits the listeners of the raised event type, in link order.
+ */
+#define ZMK_EVENT_SUBSCRIPTION_SECTION(event_type, part)                                           \
+    __attribute__((__section__(".event_subscription." STRINGIFY(event_type) "." #part)))
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+#define ZMK_EVENT_POOL_DEFINE(event_type, size)                                                    \
+    K_MEM_SLAB_DEFINE(zmk_event_slab_##event_type, sizeof(struct event_type##_event), size,        \
+                      __alignof__(struct event_type##_event));                                     \
+    static struct zmk_event_pool zmk_event_pool_##event_type = {                                   \
+        .slab = &zmk_event_slab_##event_type,                                                      \
+    };
+#define ZMK_EVENT_POOL_REF(event_type) .pool = &zmk_event_pool_##event_type,
+#else
+#define ZMK_EVENT_POOL_DEFINE(event_type, size)
+#define ZMK_EVENT_POOL_REF(event_type)
+#endif
+
 #define ZMK_EVENT_IMPL(event_type)                                                                 \
-    const struct zmk_event_type zmk_event_##event_type = {.name = STRINGIFY(event_type)};          \
+    ZMK_EVENT_IMPL_POOL(event_type, CONFIG_ZMK_EVENT_POOL_DEFAULT_SIZE)
+
+/*
+ * Like ZMK_EVENT_IMPL, but with an explicit number of events of this type that can be allocated
+ * at once when CONFIG_ZMK_EVENT_POOL is enabled.
+ */
+#define ZMK_EVENT_IMPL_POOL(event_type, pool_size)                                                 \
+    ZMK_EVENT_POOL_DEFINE(event_type, pool_size)                                                   \
+    const struct zmk_event_subscription zmk_event_subs_start_##event_type[0] __used                \
+        ZMK_EVENT_SUBSCRIPTION_SECTION(event_type, 0) = {};                                        \
+    const struct zmk_event_subscription zmk_event_subs_end_##event_type[0] __used                  \
+        ZMK_EVENT_SUBSCRIPTION_SECTION(event_type, 2) = {};                                        \
+    const struct zmk_event_type zmk_event_##event_type = {                                         \
+        .name = STRINGIFY(event_type),                                                             \
+        .subscriptions_start = zmk_event_subs_start_##event_type,                                  \
+        .subscriptions_end = zmk_event_subs_end_##event_type,                                      \
+        ZMK_EVENT_POOL_REF(event_type)                                                             \
+    };                                                                                             \
     const struct zmk_event_type *zmk_event_ref_##event_type __used                                 \
         __attribute__((__section__(".event_type"))) = &zmk_event_##event_type;                     \
     struct event_type##_event *new_##event_type(struct event_type data) {                          \
         struct event_type##_event *ev =                                                            \
-            (struct event_type##_event *)k_malloc(sizeof(struct event_type##_event));              \
+            zmk_event_manager_alloc(&zmk_event_##event_type, sizeof(struct event_type##_event));   \
+        if (ev == NULL) {                                                                          \
+            return NULL;                                                                           \
+        }                                                                                          \
         ev->header.event = &zmk_event_##event_type;                                                \
+        ev->header.last_listener_index = 0;                                                        \
         ev->data = data;                                                                           \
         return ev;                                                                                 \
     };                                                                                             \
@@ -58,12 +127,19 @@ struct zmk_event_subscription {
                                                       : NULL;                                      \
     };
 
-#define ZMK_LISTENER(mod, cb) const struct zmk_listener zmk_listener_##mod = {.callback = cb};
+#if IS_ENABLED(CONFIG_ZMK_EVENT_TRACE)
+#define ZMK_LISTENER_NAME(mod) .name = STRINGIFY(mod),
+#else
+#define ZMK_LISTENER_NAME(mod)
+#endif
+
+#define ZMK_LISTENER(mod, cb)                                                                      \
+    const struct zmk_listener zmk_listener_##mod = {.callback = cb, ZMK_LISTENER_NAME(mod)};
 
 #define ZMK_SUBSCRIPTION(mod, ev_type)                                                             \
     const Z_DECL_ALIGN(struct zmk_event_subscription)                                              \
         _CONCAT(_CONCAT(zmk_event_sub_, mod), ev_type) __used                                      \
-        __attribute__((__section__(".event_subscription"))) = {                                    \
+        ZMK_EVENT_SUBSCRIPTION_SECTION(ev_type, 1) = {                                             \
             .event_type = &zmk_event_##ev_type,                                                    \
             .listener = &zmk_listener_##mod,                                                       \
     };
@@ -78,9 +154,36 @@ struct zmk_event_subscription {
 
 #define ZMK_EVENT_RELEASE(ev) zmk_event_manager_release((zmk_event_t *)ev);
 
-#define ZMK_EVENT_FREE(ev) k_free((void *)ev);
+#define ZMK_EVENT_FREE(ev) zmk_event_manager_free((zmk_event_t *)ev);
+
+void *zmk_event_manager_alloc(const struct zmk_event_type *type, size_t size);
+void zmk_event_manager_free(zmk_event_t *event);
+int zmk_event_manager_get_pool_stats(const struct zmk_event_type *type,
+                                     struct zmk_event_pool_stats *stats);
+void zmk_event_manager_log_pool_stats(void);
 
 int zmk_event_manager_raise(zmk_event_t *event);
 int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener);
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener);
-int zmk_event_manager_release(zmk_event_t *event);
\ No newline at end of file
+int zmk_event_manager_release(zmk_event_t *event);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_TRACE)
+
+struct zmk_event_trace_entry {
+    const struct zmk_event_type *event_type;
+    const struct zmk_listener *listener;
+    // Hardware cycle counter values when the listener was entered and returned
+    uint32_t enter;
+    uint32_t exit;
+    int16_t ret;
+};
+
+/*
+ * Copies up to max_entries of the most recent trace entries, oldest first, and returns the number
+ * of entries copied.
+ */
+int zmk_event_trace_read(struct zmk_event_trace_entry *entries, int max_entries);
+void zmk_event_trace_clear(void);
+void zmk_event_trace_log(void);
+
+#endif
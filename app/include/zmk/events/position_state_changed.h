@@ -16,6 +16,10 @@ struct zmk_position_state_changed {
     uint32_t position;
     bool state;
     int64_t timestamp;
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+    // Cycle counter value when the change was detected, for end-to-end latency statistics
+    uint32_t scan_cycles;
+#endif
 };
 
 ZMK_EVENT_DECLARE(zmk_position_state_changed);
@@ -197,3 +197,18 @@ struct zmk_hid_consumer_report *zmk_hid_get_consumer_report();
 #if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
 zmk_hid_boot_report_t *zmk_hid_get_boot_report();
 #endif
+
+/*
+ * A report is dirty when it differs from the copy last marked as sent. Callers mark a report
+ * sent once the host has received it, and mark all reports unsent when the host may have lost
+ * track of them, which forces the next send of each through.
+ */
+bool zmk_hid_keyboard_report_is_dirty();
+void zmk_hid_keyboard_report_mark_sent();
+bool zmk_hid_consumer_report_is_dirty();
+void zmk_hid_consumer_report_mark_sent();
+void zmk_hid_reports_mark_unsent();
+
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+bool zmk_hid_boot_report_is_dirty();
+#endif
@@ -6,9 +6,65 @@
 
 #pragma once
 
+#include <devicetree.h>
+#include <sys/util.h>
 #include <zmk/events/position_state_changed.h>
 
-typedef uint32_t zmk_keymap_layers_state_t;
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_keymap)
+#define ZMK_KEYMAP_LAYER_CHILD_LEN(node) 1 +
+#define ZMK_KEYMAP_LAYERS_LEN                                                                      \
+    (DT_FOREACH_CHILD(DT_INST(0, zmk_keymap), ZMK_KEYMAP_LAYER_CHILD_LEN) 0)
+#else
+#define ZMK_KEYMAP_LAYERS_LEN 1
+#endif
+
+#define ZMK_KEYMAP_LAYERS_STATE_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LAYERS_LEN, 32)
+
+// One bit per layer, spread over as many 32-bit words as the keymap has layers for
+typedef struct {
+    uint32_t words[ZMK_KEYMAP_LAYERS_STATE_WORDS];
+} zmk_keymap_layers_state_t;
+
+static inline bool zmk_keymap_layers_state_test(const zmk_keymap_layers_state_t *state,
+                                                uint8_t layer) {
+    return (state->words[layer / 32] & BIT(layer % 32)) != 0;
+}
+
+static inline void zmk_keymap_layers_state_write(zmk_keymap_layers_state_t *state, uint8_t layer,
+                                                 bool value) {
+    WRITE_BIT(state->words[layer / 32], layer % 32, value);
+}
+
+static inline bool zmk_keymap_layers_state_equal(const zmk_keymap_layers_state_t *a,
+                                                 const zmk_keymap_layers_state_t *b) {
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        if (a->words[i] != b->words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether every layer set in mask is also set in state
+static inline bool zmk_keymap_layers_state_contains(const zmk_keymap_layers_state_t *state,
+                                                    const zmk_keymap_layers_state_t *mask) {
+    for (int i = 0; i < ZMK_KEYMAP_LAYERS_STATE_WORDS; i++) {
+        if ((state->words[i] & mask->words[i]) != mask->words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Highest layer set in state, or -1 if none is
+static inline int zmk_keymap_layers_state_highest(const zmk_keymap_layers_state_t *state) {
+    for (int i = ZMK_KEYMAP_LAYERS_STATE_WORDS - 1; i >= 0; i--) {
+        if (state->words[i] != 0) {
+            return i * 32 + 31 - __builtin_clz(state->words[i]);
+        }
+    }
+    return -1;
+}
 
 uint8_t zmk_keymap_layer_default();
 zmk_keymap_layers_state_t zmk_keymap_layer_state();
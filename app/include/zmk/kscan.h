@@ -6,4 +6,20 @@
 
 #pragma once
 
+#include <zephyr/types.h>
+
 int zmk_kscan_init(char *name);
+
+/*
+ * Starts a batch of changes found by one scan, detected at the given uptime in milliseconds. kscan
+ * drivers call this before reporting the changes from a scan and zmk_kscan_end_batch() after. All
+ * changes passed to the kscan callback in between are queued together, timestamped with the scan
+ * rather than with the time they are processed, and raised in position order. All in-tree drivers
+ * batch their scans. Changes reported outside of a batch are queued one at a time and timestamped
+ * when the callback runs.
+ */
+void zmk_kscan_begin_batch(int64_t timestamp);
+void zmk_kscan_end_batch(void);
+
+// Number of kscan events, each holding the changes from one scan, dropped due to a full queue
+uint32_t zmk_kscan_get_dropped_events(void);
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <sys/util.h>
+#include <zephyr/types.h>
+#include <zmk/endpoints_types.h>
+
+enum zmk_latency_source {
+    ZMK_LATENCY_SOURCE_LOCAL,
+    ZMK_LATENCY_SOURCE_PERIPHERAL,
+    ZMK_LATENCY_SOURCE_COUNT,
+};
+
+#define ZMK_LATENCY_ENDPOINT_COUNT (ZMK_ENDPOINT_BLE + 1)
+
+struct zmk_latency_stats {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t avg_us;
+    // Upper bound of the histogram bucket containing the 99th percentile
+    uint32_t p99_us;
+    uint32_t max_us;
+};
+
+/*
+ * Marks the start of processing a key position change that was detected at scan_cycles. The first
+ * report sent before zmk_latency_end() is attributed to it.
+ */
+void zmk_latency_begin(uint8_t position_source, uint32_t scan_cycles);
+void zmk_latency_end(void);
+
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+// Records the latency of the current key position change when a report is handed to an endpoint
+void zmk_latency_record(enum zmk_endpoint endpoint);
+/*
+ * Keeps the current key position change pending past zmk_latency_end(), for a report that is sent
+ * later. If several changes are deferred before that report goes out, the oldest is recorded.
+ */
+void zmk_latency_defer(void);
+// Ends a deferred key position change once its reports were sent, skipped as unchanged or failed
+void zmk_latency_end_deferred(void);
+#else
+static inline void zmk_latency_record(enum zmk_endpoint endpoint) {}
+static inline void zmk_latency_defer(void) {}
+static inline void zmk_latency_end_deferred(void) {}
+#endif
+
+int zmk_latency_get_stats(enum zmk_endpoint endpoint, enum zmk_latency_source source,
+                          struct zmk_latency_stats *stats);
+void zmk_latency_reset(void);
+void zmk_latency_log(void);
@@ -6,8 +6,10 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+bool zmk_usb_hid_keyboard_report_is_dirty();
 int zmk_usb_hid_send_keyboard_report();
 int zmk_usb_hid_send_consumer_report();
 void zmk_usb_hid_set_protocol(uint8_t protocol);
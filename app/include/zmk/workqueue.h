@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <kernel.h>
+
+/**
+ * Work queue for everything on the path from a key scan to a HID report: kscan drivers, kscan
+ * event processing, encoder triggers, split peripheral events, behavior timers, the behavior queue
+ * and USB and BLE connection changes, which switch endpoints and clear the HID reports. None of
+ * this state is locked, so it must only be touched from this queue. This is the system work queue
+ * unless CONFIG_ZMK_INPUT_WORK_QUEUE_DEDICATED is enabled.
+ */
+struct k_work_q *zmk_input_work_q(void);
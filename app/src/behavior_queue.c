@@ -9,6 +9,7 @@
 #include <kernel.h>
 #include <logging/log.h>
 #include <drivers/behavior.h>
+#include <zmk/deadline.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -21,10 +22,10 @@ struct q_item {
 
 K_MSGQ_DEFINE(zmk_behavior_queue_msgq, sizeof(struct q_item), CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE, 4);
 
-static void behavior_queue_process_next(struct k_work *work);
-static K_WORK_DELAYABLE_DEFINE(queue_work, behavior_queue_process_next);
+static void behavior_queue_process_next(struct zmk_deadline *deadline);
+static struct zmk_deadline queue_deadline = ZMK_DEADLINE_INITIALIZER(behavior_queue_process_next);
 
-static void behavior_queue_process_next(struct k_work *work) {
+static void behavior_queue_process_next(struct zmk_deadline *deadline) {
     struct q_item item = {.wait = 0};
 
     while (k_msgq_get(&zmk_behavior_queue_msgq, &item, K_NO_WAIT) == 0) {
@@ -32,7 +33,7 @@ static void behavior_queue_process_next(struct k_work *work) {
                 item.binding.param1, item.binding.param2);
 
         struct zmk_behavior_binding_event event = {.position = item.position,
-                                                   .timestamp = k_uptime_get()};
+                                                   .timestamp = zmk_deadline_now()};
 
         if (item.press) {
             behavior_keymap_binding_pressed(&item.binding, event);
@@ -43,7 +44,7 @@ static void behavior_queue_process_next(struct k_work *work) {
         LOG_DBG("Processing next queued behavior in %dms", item.wait);
 
         if (item.wait > 0) {
-            k_work_schedule(&queue_work, K_MSEC(item.wait));
+            zmk_deadline_schedule(&queue_deadline, event.timestamp + item.wait);
             break;
         }
     }
@@ -58,8 +59,8 @@ int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding
         return ret;
     }
 
-    if (!k_work_delayable_is_pending(&queue_work)) {
-        behavior_queue_process_next(&queue_work.work);
+    if (!zmk_deadline_is_scheduled(&queue_deadline)) {
+        behavior_queue_process_next(&queue_deadline);
     }
 
     return 0;
@@ -19,13 +19,14 @@
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
+#include <zmk/deadline.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_HOLD_TAP_MAX_HELD 10
-#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 40
+#define ZMK_BHV_HOLD_TAP_MAX_HELD CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_HELD
+#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_CAPTURED_EVENTS
 
 // increase if you have keyboard with more keys.
 #define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED 9999
@@ -54,12 +55,16 @@ enum decision_moment {
 
 struct behavior_hold_tap_config {
     int tapping_term_ms;
-    char *hold_behavior_dev;
-    char *tap_behavior_dev;
+    struct zmk_behavior_binding *hold_binding;
+    struct zmk_behavior_binding *tap_binding;
     int quick_tap_ms;
     bool global_quick_tap;
+    int require_prior_idle_ms;
     enum flavor flavor;
     bool retro_tap;
+    bool hold_trigger_on_release;
+    // Bitmap of hold_trigger_key_positions, built at init
+    uint32_t *hold_trigger_keys;
     int32_t hold_trigger_key_positions_len;
     int32_t hold_trigger_key_positions[];
 };
@@ -72,8 +77,7 @@ struct active_hold_tap {
     int64_t timestamp;
     enum status status;
     const struct behavior_hold_tap_config *config;
-    struct k_work_delayable work;
-    bool work_is_cancelled;
+    struct zmk_deadline deadline;
 
     // initialized to -1, which is to be interpreted as "no other key has been pressed yet"
     int32_t position_of_first_other_key_pressed;
@@ -83,11 +87,24 @@ struct active_hold_tap {
 // other keypress events can be released. While the undecided_hold_tap is
 // not NULL, most events are captured in captured_events.
 // After the hold_tap is decided, it will stay in the active_hold_taps until
-// its key-up has been processed and the delayed work is cleaned up.
+// its key-up has been processed.
 struct active_hold_tap *undecided_hold_tap = NULL;
 struct active_hold_tap active_hold_taps[ZMK_BHV_HOLD_TAP_MAX_HELD] = {};
 // We capture most position_state_changed events and some modifiers_state_changed events.
+// Captured events are kept in a ring buffer, indexed by counters which only ever increase.
 const zmk_event_t *captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+// Oldest event which has not been released yet.
+static uint32_t captured_start;
+// One past the newest captured event.
+static uint32_t captured_end;
+// First event captured by the undecided hold-tap. Older events are being released.
+static uint32_t captured_head;
+// Positions with a keydown event captured since captured_head.
+static uint32_t captured_keydowns[DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)];
+// Nesting depth of release_captured_events().
+static int release_depth;
+// Number of events which did not fit in captured_events.
+static uint32_t capture_overflows;
 
 // Keep track of which key was tapped most recently for the standard, if it is a hold-tap
 // a position, will be given, if not it will just be INT32_MIN
@@ -118,33 +135,31 @@ static bool is_quick_tap(struct active_hold_tap *hold_tap) {
     }
 }
 
+// While typing quickly, a hold-tap pressed shortly after another key was tapped is a tap.
+static bool is_typing_streak(struct active_hold_tap *hold_tap) {
+    return hold_tap->config->require_prior_idle_ms > 0 &&
+           (last_tapped.timestamp + hold_tap->config->require_prior_idle_ms) > hold_tap->timestamp;
+}
+
 static int capture_event(const zmk_event_t *event) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        if (captured_events[i] == NULL) {
-            captured_events[i] = event;
-            return 0;
-        }
+    if (captured_end - captured_start >= ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS) {
+        return -ENOMEM;
     }
-    return -ENOMEM;
-}
 
-static struct zmk_position_state_changed *find_captured_keydown_event(uint32_t position) {
-    struct zmk_position_state_changed *last_match = NULL;
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *eh = captured_events[i];
-        if (eh == NULL) {
-            return last_match;
-        }
-        struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(eh);
-        if (position_event == NULL) {
-            continue;
-        }
+    captured_events[captured_end % ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = event;
+    captured_end++;
 
-        if (position_event->position == position && position_event->state) {
-            last_match = position_event;
-        }
+    struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(event);
+    if (position_event != NULL && position_event->state &&
+        position_event->position < ZMK_KEYMAP_LEN) {
+        WRITE_BIT(captured_keydowns[position_event->position / 32], position_event->position % 32,
+                  true);
     }
-    return last_match;
+    return 0;
+}
+
+static bool is_keydown_captured(uint32_t position) {
+    return position < ZMK_KEYMAP_LEN && (captured_keydowns[position / 32] & BIT(position % 32));
 }
 
 const struct zmk_listener zmk_listener_behavior_hold_tap;
@@ -154,37 +169,39 @@ static void release_captured_events() {
         return;
     }
 
-    // We use a trick to prevent copying the captured_events array.
-    //
-    // Events for different mod-tap instances are separated by a NULL pointer.
-    //
-    // The first event popped will never be catched by the next active hold-tap
-    // because to start capturing a mod-tap-key-down event must first completely
-    // go through the events queue.
+    // Releasing an event may start a new undecided hold-tap, which captures the events that
+    // follow. Those are appended after the events released here, starting a new segment at
+    // captured_head.
     //
     // Example of this release process;
-    // [mt2_down, k1_down, k1_up, mt2_up, null, ...]
+    // [mt2_down, k1_down, k1_up, mt2_up]
     //  ^
     // mt2_down position event isn't captured because no hold-tap is active.
     // mt2_down behavior event is handled, now we have an undecided hold-tap
-    // [null, k1_down, k1_up, mt2_up, null, ...]
-    //        ^
-    // k1_down  is captured by the mt2 mod-tap
-    // !note that searches for find_captured_keydown_event by the mt2 behavior will stop at the
-    // first null encountered [mt1_down, null, k1_up, mt2_up, null, ...]
-    //                  ^
-    // k1_up event is captured by the new hold-tap:
-    // [k1_down, k1_up, null, mt2_up, null, ...]
-    //                        ^
-    // mt2_up event is not captured but causes release of mt2 behavior
-    // [k1_down, k1_up, null, null, null, ...]
-    // now mt2 will start releasing it's own captured positions.
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *captured_event = captured_events[i];
-        if (captured_event == NULL) {
-            return;
+    // [mt2_down, k1_down, k1_up, mt2_up | ]
+    //            ^
+    // k1_down and k1_up are captured by the mt2 mod-tap in its own segment
+    // [mt2_down, k1_down, k1_up, mt2_up | k1_down, k1_up]
+    //                            ^
+    // mt2_up event is not captured but causes release of mt2 behavior, which releases its own
+    // segment before this loop continues. The release of the new segment is nested inside this
+    // one, so a segment is never released before the segments captured before it.
+    //
+    // Only the outermost release frees slots in the ring, since nested releases free newer
+    // slots while older ones are still in use.
+    const uint32_t start = captured_head;
+    const uint32_t end = captured_end;
+
+    captured_head = end;
+    memset(captured_keydowns, 0, sizeof(captured_keydowns));
+    release_depth++;
+
+    for (uint32_t i = start; i != end; i++) {
+        const zmk_event_t *captured_event =
+            captured_events[i % ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS];
+        if (release_depth == 1) {
+            captured_start = i + 1;
         }
-        captured_events[i] = NULL;
         if (undecided_hold_tap != NULL) {
             k_msleep(10);
         }
@@ -200,6 +217,11 @@ static void release_captured_events() {
         }
         ZMK_EVENT_RAISE_AT(captured_event, behavior_hold_tap);
     }
+
+    release_depth--;
+    if (release_depth == 0) {
+        captured_start = captured_head;
+    }
 }
 
 static struct active_hold_tap *find_hold_tap(uint32_t position) {
@@ -233,7 +255,6 @@ static struct active_hold_tap *store_hold_tap(uint32_t position, uint32_t param_
 static void clear_hold_tap(struct active_hold_tap *hold_tap) {
     hold_tap->position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
     hold_tap->status = STATUS_UNDECIDED;
-    hold_tap->work_is_cancelled = false;
 }
 
 static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_moment event) {
@@ -278,6 +299,7 @@ static void decide_tap_unless_interrupted(struct active_hold_tap *hold_tap,
         hold_tap->status = STATUS_TAP;
         return;
     case HT_OTHER_KEY_DOWN:
+    case HT_OTHER_KEY_UP:
         hold_tap->status = STATUS_HOLD_INTERRUPT;
         return;
     case HT_TIMER_EVENT:
@@ -297,6 +319,7 @@ static void decide_hold_preferred(struct active_hold_tap *hold_tap, enum decisio
         hold_tap->status = STATUS_TAP;
         return;
     case HT_OTHER_KEY_DOWN:
+    case HT_OTHER_KEY_UP:
         hold_tap->status = STATUS_HOLD_INTERRUPT;
         return;
     case HT_TIMER_EVENT:
@@ -369,10 +392,12 @@ static int press_binding(struct active_hold_tap *hold_tap) {
 
     struct zmk_behavior_binding binding = {0};
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
+        binding.behavior_dev = hold_tap->config->hold_binding->behavior_dev;
+        binding.behavior = behavior_get_binding_device(hold_tap->config->hold_binding);
         binding.param1 = hold_tap->param_hold;
     } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
+        binding.behavior_dev = hold_tap->config->tap_binding->behavior_dev;
+        binding.behavior = behavior_get_binding_device(hold_tap->config->tap_binding);
         binding.param1 = hold_tap->param_tap;
         store_last_hold_tapped(hold_tap);
     }
@@ -391,23 +416,22 @@ static int release_binding(struct active_hold_tap *hold_tap) {
 
     struct zmk_behavior_binding binding = {0};
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
+        binding.behavior_dev = hold_tap->config->hold_binding->behavior_dev;
+        binding.behavior = behavior_get_binding_device(hold_tap->config->hold_binding);
         binding.param1 = hold_tap->param_hold;
     } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
+        binding.behavior_dev = hold_tap->config->tap_binding->behavior_dev;
+        binding.behavior = behavior_get_binding_device(hold_tap->config->tap_binding);
         binding.param1 = hold_tap->param_tap;
     }
     return behavior_keymap_binding_released(&binding, event);
 }
 
 static bool is_first_other_key_pressed_trigger_key(struct active_hold_tap *hold_tap) {
-    for (int i = 0; i < hold_tap->config->hold_trigger_key_positions_len; i++) {
-        if (hold_tap->config->hold_trigger_key_positions[i] ==
-            hold_tap->position_of_first_other_key_pressed) {
-            return true;
-        }
-    }
-    return false;
+    const int32_t position = hold_tap->position_of_first_other_key_pressed;
+
+    return position >= 0 && position < ZMK_KEYMAP_LEN &&
+           (hold_tap->config->hold_trigger_keys[position / 32] & BIT(position % 32));
 }
 
 // Force a tap decision if the positional conditions for a hold decision are not met.
@@ -444,6 +468,12 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
         return;
     }
 
+    // With hold-trigger-on-release, the positional check needs the first released key, so
+    // no decision is made when another key goes down.
+    if (decision_moment == HT_OTHER_KEY_DOWN && hold_tap->config->hold_trigger_on_release) {
+        return;
+    }
+
     // If the hold-tap behavior is still undecided, attempt to decide it.
     switch (hold_tap->config->flavor) {
     case FLAVOR_HOLD_PREFERRED:
@@ -507,7 +537,7 @@ static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
 
 static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
                                        struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
     const struct behavior_hold_tap_config *cfg = dev->config;
 
     if (undecided_hold_tap != NULL) {
@@ -527,14 +557,14 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
     LOG_DBG("%d new undecided hold_tap", event.position);
     undecided_hold_tap = hold_tap;
 
-    if (is_quick_tap(hold_tap)) {
+    if (is_quick_tap(hold_tap) || is_typing_streak(hold_tap)) {
+        // Decided on press, so nothing is captured and no timer is needed.
         decide_hold_tap(hold_tap, HT_QUICK_TAP);
+        return ZMK_BEHAVIOR_OPAQUE;
     }
 
-    // if this behavior was queued we have to adjust the timer to only
-    // wait for the remaining time.
-    int32_t tapping_term_ms_left = (hold_tap->timestamp + cfg->tapping_term_ms) - k_uptime_get();
-    k_work_schedule(&hold_tap->work, K_MSEC(tapping_term_ms_left));
+    // if this behavior was queued, the deadline only waits for the remaining time.
+    zmk_deadline_schedule(&hold_tap->deadline, hold_tap->timestamp + cfg->tapping_term_ms);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -549,7 +579,7 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
 
     // If these events were queued, the timer event may be queued too late or not at all.
     // We insert a timer event before the TH_KEY_UP event to verify.
-    int work_cancel_result = k_work_cancel_delayable(&hold_tap->work);
+    zmk_deadline_cancel(&hold_tap->deadline);
     if (event.timestamp > (hold_tap->timestamp + hold_tap->config->tapping_term_ms)) {
         decide_hold_tap(hold_tap, HT_TIMER_EVENT);
     }
@@ -558,15 +588,8 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
     decide_retro_tap(hold_tap);
     release_binding(hold_tap);
 
-    if (work_cancel_result == -EINPROGRESS) {
-        // let the timer handler clean up
-        // if we'd clear now, the timer may call back for an uninitialized active_hold_tap.
-        LOG_DBG("%d hold-tap timer work in event queue", event.position);
-        hold_tap->work_is_cancelled = true;
-    } else {
-        LOG_DBG("%d cleaning up hold-tap", event.position);
-        clear_hold_tap(hold_tap);
-    }
+    LOG_DBG("%d cleaning up hold-tap", event.position);
+    clear_hold_tap(hold_tap);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -576,6 +599,15 @@ static const struct behavior_driver_api behavior_hold_tap_driver_api = {
     .binding_released = on_hold_tap_binding_released,
 };
 
+// Called when an event does not fit in captured_events. The undecided hold-tap is decided as if
+// its tapping term expired, which releases the captured events so this one can follow them.
+static void handle_capture_overflow(void) {
+    capture_overflows++;
+    LOG_WRN("%d hold-tap captured too many events (%d overflows), deciding it early",
+            undecided_hold_tap->position, capture_overflows);
+    decide_hold_tap(undecided_hold_tap, HT_TIMER_EVENT);
+}
+
 static int position_state_changed_listener(const zmk_event_t *eh) {
     struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
 
@@ -588,6 +620,7 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     // Store the position of pressed key for positional hold-tap purposes.
     if ((ev->state) // i.e. key pressed (not released)
+        && !undecided_hold_tap->config->hold_trigger_on_release
         && (undecided_hold_tap->position_of_first_other_key_pressed ==
             -1) // i.e. no other key has been pressed yet
     ) {
@@ -616,7 +649,7 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
         return ZMK_EV_EVENT_BUBBLE;
     }
 
-    if (!ev->state && find_captured_keydown_event(ev->position) == NULL) {
+    if (!ev->state && !is_keydown_captured(ev->position)) {
         // no keydown event has been captured, let it bubble.
         // we'll catch modifiers later in modifier_state_changed_listener
         LOG_DBG("%d bubbling %d %s event", undecided_hold_tap->position, ev->position,
@@ -624,9 +657,19 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
         return ZMK_EV_EVENT_BUBBLE;
     }
 
+    // With hold-trigger-on-release, store the position of the first released key instead. Only
+    // keys which were pressed while the hold-tap was undecided get this far.
+    if (!ev->state && undecided_hold_tap->config->hold_trigger_on_release &&
+        undecided_hold_tap->position_of_first_other_key_pressed == -1) {
+        undecided_hold_tap->position_of_first_other_key_pressed = ev->position;
+    }
+
     LOG_DBG("%d capturing %d %s event", undecided_hold_tap->position, ev->position,
             ev->state ? "down" : "up");
-    capture_event(eh);
+    if (capture_event(eh) < 0) {
+        handle_capture_overflow();
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     decide_hold_tap(undecided_hold_tap, ev->state ? HT_OTHER_KEY_DOWN : HT_OTHER_KEY_UP);
     return ZMK_EV_EVENT_CAPTURED;
 }
@@ -653,7 +696,10 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
     // if a undecided_hold_tap is active.
     LOG_DBG("%d capturing 0x%02X %s event", undecided_hold_tap->position, ev->keycode,
             ev->state ? "down" : "up");
-    capture_event(eh);
+    if (capture_event(eh) < 0) {
+        handle_capture_overflow();
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     return ZMK_EV_EVENT_CAPTURED;
 }
 
@@ -671,22 +717,29 @@ ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_position_state_changed);
 // this should be modifiers_state_changed, but unfrotunately that's not implemented yet.
 ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_keycode_state_changed);
 
-void behavior_hold_tap_timer_work_handler(struct k_work *item) {
-    struct active_hold_tap *hold_tap = CONTAINER_OF(item, struct active_hold_tap, work);
+static void behavior_hold_tap_timer_handler(struct zmk_deadline *deadline) {
+    struct active_hold_tap *hold_tap = CONTAINER_OF(deadline, struct active_hold_tap, deadline);
 
-    if (hold_tap->work_is_cancelled) {
-        clear_hold_tap(hold_tap);
-    } else {
-        decide_hold_tap(hold_tap, HT_TIMER_EVENT);
-    }
+    decide_hold_tap(hold_tap, HT_TIMER_EVENT);
 }
 
 static int behavior_hold_tap_init(const struct device *dev) {
     static bool init_first_run = true;
+    const struct behavior_hold_tap_config *cfg = dev->config;
+
+    for (int i = 0; i < cfg->hold_trigger_key_positions_len; i++) {
+        const int32_t position = cfg->hold_trigger_key_positions[i];
+
+        if (position < 0 || position >= ZMK_KEYMAP_LEN) {
+            LOG_WRN("Ignoring hold-trigger-key-positions entry %d outside of the keymap", position);
+            continue;
+        }
+        WRITE_BIT(cfg->hold_trigger_keys[position / 32], position % 32, true);
+    }
 
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-            k_work_init_delayable(&active_hold_taps[i].work, behavior_hold_tap_timer_work_handler);
+            zmk_deadline_init(&active_hold_taps[i].deadline, behavior_hold_tap_timer_handler);
             active_hold_taps[i].position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
         }
     }
@@ -695,14 +748,23 @@ static int behavior_hold_tap_init(const struct device *dev) {
 }
 
 #define KP_INST(n)                                                                                 \
+    static struct zmk_behavior_binding behavior_hold_tap_config_##n##_bindings[] = {               \
+        {.behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 0))},                        \
+        {.behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 1))},                        \
+    };                                                                                             \
+    static uint32_t behavior_hold_tap_config_##n##_hold_trigger_keys[DIV_ROUND_UP(                 \
+        ZMK_KEYMAP_LEN, 32)];                                                                      \
     static struct behavior_hold_tap_config behavior_hold_tap_config_##n = {                        \
         .tapping_term_ms = DT_INST_PROP(n, tapping_term_ms),                                       \
-        .hold_behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 0)),                     \
-        .tap_behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 1)),                      \
+        .hold_binding = &behavior_hold_tap_config_##n##_bindings[0],                               \
+        .tap_binding = &behavior_hold_tap_config_##n##_bindings[1],                                \
         .quick_tap_ms = DT_INST_PROP(n, quick_tap_ms),                                             \
         .global_quick_tap = DT_INST_PROP(n, global_quick_tap),                                     \
+        .require_prior_idle_ms = DT_INST_PROP(n, require_prior_idle_ms),                           \
         .flavor = DT_ENUM_IDX(DT_DRV_INST(n), flavor),                                             \
         .retro_tap = DT_INST_PROP(n, retro_tap),                                                   \
+        .hold_trigger_on_release = DT_INST_PROP(n, hold_trigger_on_release),                       \
+        .hold_trigger_keys = behavior_hold_tap_config_##n##_hold_trigger_keys,                     \
         .hold_trigger_key_positions = DT_INST_PROP(n, hold_trigger_key_positions),                 \
         .hold_trigger_key_positions_len = DT_INST_PROP_LEN(n, hold_trigger_key_positions),         \
     };                                                                                             \
@@ -115,6 +115,8 @@ static void queue_macro(uint32_t position, const struct zmk_behavior_binding bin
     LOG_DBG("Iterating macro bindings - starting: %d, count: %d", state.start_index, state.count);
     for (int i = state.start_index; i < state.start_index + state.count; i++) {
         if (!handle_control_binding(&state, &bindings[i])) {
+            // Resolve the device in place so every queued copy carries it
+            behavior_get_binding_device((struct zmk_behavior_binding *)&bindings[i]);
             switch (state.mode) {
             case MACRO_MODE_TAP:
                 zmk_behavior_queue_add(position, bindings[i], true, state.tap_ms);
@@ -136,7 +138,7 @@ static void queue_macro(uint32_t position, const struct zmk_behavior_binding bin
 
 static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                     struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
     struct behavior_macro_trigger_state trigger_state = {.mode = MACRO_MODE_TAP,
@@ -152,7 +154,7 @@ static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
 
 static int on_macro_binding_released(struct zmk_behavior_binding *binding,
                                      struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
 
@@ -19,6 +19,7 @@
 #include <zmk/events/modifiers_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
+#include <zmk/deadline.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -32,7 +33,7 @@ struct behavior_sticky_key_config {
     uint32_t release_after_ms;
     bool quick_release;
     bool ignore_modifiers;
-    struct zmk_behavior_binding behavior;
+    struct zmk_behavior_binding *behavior;
 };
 
 struct active_sticky_key {
@@ -42,9 +43,8 @@ struct active_sticky_key {
     const struct behavior_sticky_key_config *config;
     // timer data.
     bool timer_started;
-    bool timer_cancelled;
     int64_t release_at;
-    struct k_work_delayable release_timer;
+    struct zmk_deadline release_deadline;
     // usage page and keycode for the key that is being modified by this sticky key
     uint8_t modified_key_usage_page;
     uint32_t modified_key_keycode;
@@ -57,8 +57,7 @@ static struct active_sticky_key *store_sticky_key(uint32_t position, uint32_t pa
                                                   const struct behavior_sticky_key_config *config) {
     for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
         struct active_sticky_key *const sticky_key = &active_sticky_keys[i];
-        if (sticky_key->position != ZMK_BHV_STICKY_KEY_POSITION_FREE ||
-            sticky_key->timer_cancelled) {
+        if (sticky_key->position != ZMK_BHV_STICKY_KEY_POSITION_FREE) {
             continue;
         }
         sticky_key->position = position;
@@ -66,7 +65,6 @@ static struct active_sticky_key *store_sticky_key(uint32_t position, uint32_t pa
         sticky_key->param2 = param2;
         sticky_key->config = config;
         sticky_key->release_at = 0;
-        sticky_key->timer_cancelled = false;
         sticky_key->timer_started = false;
         sticky_key->modified_key_usage_page = 0;
         sticky_key->modified_key_keycode = 0;
@@ -81,7 +79,7 @@ static void clear_sticky_key(struct active_sticky_key *sticky_key) {
 
 static struct active_sticky_key *find_sticky_key(uint32_t position) {
     for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        if (active_sticky_keys[i].position == position && !active_sticky_keys[i].timer_cancelled) {
+        if (active_sticky_keys[i].position == position) {
             return &active_sticky_keys[i];
         }
     }
@@ -91,7 +89,8 @@ static struct active_sticky_key *find_sticky_key(uint32_t position) {
 static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key,
                                             int64_t timestamp) {
     struct zmk_behavior_binding binding = {
-        .behavior_dev = sticky_key->config->behavior.behavior_dev,
+        .behavior_dev = sticky_key->config->behavior->behavior_dev,
+        .behavior = behavior_get_binding_device(sticky_key->config->behavior),
         .param1 = sticky_key->param1,
         .param2 = sticky_key->param2,
     };
@@ -105,7 +104,8 @@ static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key
 static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_key,
                                               int64_t timestamp) {
     struct zmk_behavior_binding binding = {
-        .behavior_dev = sticky_key->config->behavior.behavior_dev,
+        .behavior_dev = sticky_key->config->behavior->behavior_dev,
+        .behavior = behavior_get_binding_device(sticky_key->config->behavior),
         .param1 = sticky_key->param1,
         .param2 = sticky_key->param2,
     };
@@ -118,18 +118,13 @@ static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_k
     return behavior_keymap_binding_released(&binding, event);
 }
 
-static int stop_timer(struct active_sticky_key *sticky_key) {
-    int timer_cancel_result = k_work_cancel_delayable(&sticky_key->release_timer);
-    if (timer_cancel_result == -EINPROGRESS) {
-        // too late to cancel, we'll let the timer handler clear up.
-        sticky_key->timer_cancelled = true;
-    }
-    return timer_cancel_result;
+static void stop_timer(struct active_sticky_key *sticky_key) {
+    zmk_deadline_cancel(&sticky_key->release_deadline);
 }
 
 static int on_sticky_key_binding_pressed(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = behavior_get_binding_device(binding);
     const struct behavior_sticky_key_config *cfg = dev->config;
     struct active_sticky_key *sticky_key;
     sticky_key = find_sticky_key(event.position);
@@ -166,9 +161,8 @@ static int on_sticky_key_binding_released(struct zmk_behavior_binding *binding,
     sticky_key->timer_started = true;
     sticky_key->release_at = event.timestamp + sticky_key->config->release_after_ms;
     // adjust timer in case this behavior was queued by a hold-tap
-    int32_t ms_left = sticky_key->release_at - k_uptime_get();
-    if (ms_left > 0) {
-        k_work_schedule(&sticky_key->release_timer, K_MSEC(ms_left));
+    if (sticky_key->release_at > zmk_deadline_now()) {
+        zmk_deadline_schedule(&sticky_key->release_deadline, sticky_key->release_at);
     }
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -197,7 +191,7 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
             continue;
         }
 
-        if (strcmp(sticky_key->config->behavior.behavior_dev, "KEY_PRESS") == 0 &&
+        if (strcmp(sticky_key->config->behavior->behavior_dev, "KEY_PRESS") == 0 &&
             ZMK_HID_USAGE_ID(sticky_key->param1) == ev->keycode &&
             ZMK_HID_USAGE_PAGE(sticky_key->param1) == ev->usage_page &&
             SELECT_MODS(sticky_key->param1) == ev->implicit_modifiers) {
@@ -251,25 +245,21 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
     return ZMK_EV_EVENT_BUBBLE;
 }
 
-void behavior_sticky_key_timer_handler(struct k_work *item) {
+static void behavior_sticky_key_timer_handler(struct zmk_deadline *deadline) {
     struct active_sticky_key *sticky_key =
-        CONTAINER_OF(item, struct active_sticky_key, release_timer);
+        CONTAINER_OF(deadline, struct active_sticky_key, release_deadline);
     if (sticky_key->position == ZMK_BHV_STICKY_KEY_POSITION_FREE) {
         return;
     }
-    if (sticky_key->timer_cancelled) {
-        sticky_key->timer_cancelled = false;
-    } else {
-        release_sticky_key_behavior(sticky_key, sticky_key->release_at);
-    }
+    release_sticky_key_behavior(sticky_key, sticky_key->release_at);
 }
 
 static int behavior_sticky_key_init(const struct device *dev) {
     static bool init_first_run = true;
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-            k_work_init_delayable(&active_sticky_keys[i].release_timer,
-                                  behavior_sticky_key_timer_handler);
+            zmk_deadline_init(&active_sticky_keys[i].release_deadline,
+                              behavior_sticky_key_timer_handler);
             active_sticky_keys[i].position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
         }
     }
@@ -281,8 +271,10 @@ struct behavior_sticky_key_data {};
 static struct behavior_sticky_key_data behavior_sticky_key_data;
 
 #define KP_INST(n)                                                                                 \
+    static struct zmk_behavior_binding behavior_sticky_key_config_##n##_binding =                  \
+        ZMK_KEYMAP_EXTRACT_BINDING(0, DT_DRV_INST(n));                                             \
     static struct behavior_sticky_key_config behavior_sticky_key_config_##n = {                    \
-        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, DT_DRV_INST(n)),                                 \
+        .behavior = &behavior_sticky_key_config_##n##_binding,                                     \
         .release_after_ms = DT_INST_PROP(n, release_after_ms),                                     \
         .ignore_modifiers = DT_INST_PROP(n, ignore_modifiers),                                     \
         .quick_release = DT_INST_PROP(n, quick_release),                                           \
@@ -34,6 +34,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/keys.h>
 #include <zmk/split/bluetooth/uuid.h>
 #include <zmk/event_manager.h>
+#include <zmk/workqueue.h>
 #include <zmk/events/ble_active_profile_changed.h>
 
 #if IS_ENABLED(CONFIG_ZMK_BLE_PASSKEY_ENTRY)
@@ -113,7 +114,7 @@ void set_profile_address(uint8_t index, const bt_addr_le_t *addr) {
     sprintf(setting_name, "ble/profiles/%d", index);
     LOG_DBG("Setting profile addr for %s to %s", log_strdup(setting_name), log_strdup(addr_str));
     settings_save_one(setting_name, &profiles[index], sizeof(struct zmk_ble_profile));
-    k_work_submit(&raise_profile_changed_event_work);
+    k_work_submit_to_queue(zmk_input_work_q(), &raise_profile_changed_event_work);
 }
 
 bool zmk_ble_active_profile_is_connected() {
@@ -434,7 +435,7 @@ static void connected(struct bt_conn *conn, uint8_t err) {
 
     if (is_conn_active_profile(conn)) {
         LOG_DBG("Active profile connected");
-        k_work_submit(&raise_profile_changed_event_work);
+        k_work_submit_to_queue(zmk_input_work_q(), &raise_profile_changed_event_work);
     }
 }
 
@@ -459,7 +460,7 @@ static void disconnected(struct bt_conn *conn, uint8_t reason) {
 
     if (is_conn_active_profile(conn)) {
         LOG_DBG("Active profile disconnected");
-        k_work_submit(&raise_profile_changed_event_work);
+        k_work_submit_to_queue(zmk_input_work_q(), &raise_profile_changed_event_work);
     }
 }
 
@@ -13,6 +13,8 @@
 #include <kernel.h>
 
 #include <zmk/behavior.h>
+#include <zmk/benchmark.h>
+#include <zmk/deadline.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/hid.h>
@@ -23,10 +25,31 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
+#define COMBO_ONE(n) +1
+#define COMBO_COUNT (0 DT_INST_FOREACH_CHILD(0, COMBO_ONE))
+
+#define COMBO_KEYS_LEN(n) +DT_PROP_LEN(n, key_positions)
+// Number of key positions used by all combos together
+#define COMBO_KEY_COUNT (0 DT_INST_FOREACH_CHILD(0, COMBO_KEYS_LEN))
+
+// Number of 32-bit words in a mask with one bit per combo
+#define COMBO_MASK_WORDS DIV_ROUND_UP(COMBO_COUNT, 32)
+// Number of 32-bit words in a mask with one bit per key position
+#define POSITION_MASK_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)
+
+// Per-combo state derived from its config at init
+struct combo_data {
+    // RAM copy of the binding, so its device is resolved once instead of on every press
+    struct zmk_behavior_binding behavior;
+    // bit mask of key_positions
+    uint32_t key_mask[POSITION_MASK_WORDS];
+};
+
 struct combo_cfg {
     int32_t key_positions[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
     int32_t key_position_len;
     struct zmk_behavior_binding behavior;
+    struct combo_data *data;
     int32_t timeout_ms;
     // if slow release is set, the combo releases when the last key is released.
     // otherwise, the combo releases when the first key is released.
@@ -38,196 +61,248 @@ struct combo_cfg {
     int8_t layers[];
 };
 
+#define COMBO_KEY_POSITION_CHECK(i, n)                                                             \
+    BUILD_ASSERT(DT_PROP_BY_IDX(n, key_positions, i) < ZMK_KEYMAP_LEN,                             \
+                 "Combo key position does not exist in the keymap");
+
+#define COMBO_LAYER_CHECK(i, n)                                                                    \
+    BUILD_ASSERT(DT_PROP_BY_IDX(n, layers, i) >= -1 &&                                             \
+                     DT_PROP_BY_IDX(n, layers, i) < ZMK_KEYMAP_LAYERS_LEN,                         \
+                 "Combo layer does not exist in the keymap");
+
+#define COMBO_INST(n)                                                                              \
+    BUILD_ASSERT(DT_PROP_LEN(n, key_positions) <= CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO,             \
+                 "Combo has more keys than CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO");                  \
+    UTIL_LISTIFY(DT_PROP_LEN(n, key_positions), COMBO_KEY_POSITION_CHECK, n)                       \
+    UTIL_LISTIFY(DT_PROP_LEN(n, layers), COMBO_LAYER_CHECK, n)                                     \
+    static struct combo_data combo_data_##n;                                                       \
+    static const struct combo_cfg combo_config_##n = {                                             \
+        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
+        .key_positions = DT_PROP(n, key_positions),                                                \
+        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
+        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
+        .data = &combo_data_##n,                                                                   \
+        .virtual_key_position = ZMK_KEYMAP_LEN + __COUNTER__,                                      \
+        .slow_release = DT_PROP(n, slow_release),                                                  \
+        .layers = DT_PROP(n, layers),                                                              \
+        .layers_len = DT_PROP_LEN(n, layers),                                                      \
+    };
+
+DT_INST_FOREACH_CHILD(0, COMBO_INST)
+
+#define COMBO_REF(n) &combo_config_##n,
+
+// all combos in devicetree order. bit i of a combo mask refers to combos[i].
+static const struct combo_cfg *const combos[] = {DT_INST_FOREACH_CHILD(0, COMBO_REF)};
+
+// A bitmask of the layers of each combo, built at init since it may span several words.
+static zmk_keymap_layers_state_t combo_layer_masks[COMBO_COUNT];
+
 struct active_combo {
-    struct combo_cfg *combo;
+    const struct combo_cfg *combo;
     // key_positions_pressed is filled with key_positions when the combo is pressed.
     // The keys are removed from this array when they are released.
     // Once this array is empty, the behavior is released.
     const zmk_event_t *key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
 };
 
-struct combo_candidate {
-    struct combo_cfg *combo;
-    // the time after which this behavior should be removed from candidates.
-    // by keeping track of when the candidate should be cleared there is no
-    // possibility of accidental releases.
-    int64_t timeout_at;
-};
-
 // set of keys pressed
 const zmk_event_t *pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {NULL};
-// the set of candidate combos based on the currently pressed_keys
-struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+// bit mask of the positions in pressed_keys
+uint32_t pressed_mask[POSITION_MASK_WORDS];
+// bit mask of the candidate combos based on the currently pressed_keys
+uint32_t candidates[COMBO_MASK_WORDS];
+// the time the first of pressed_keys was pressed. A candidate is removed once its timeout has
+// passed since then. By keeping track of when the candidate should be cleared there is no
+// possibility of accidental releases.
+int64_t candidates_timestamp;
 // the last candidate that was completely pressed
-struct combo_cfg *fully_pressed_combo = NULL;
-// a lookup dict that maps a key position to all combos on that position
-struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
+const struct combo_cfg *fully_pressed_combo = NULL;
+// a compressed lookup from a key position to the indices of all combos on that position.
+// the combos on position p are stored from combo_lookup_offsets[p] up to
+// combo_lookup_offsets[p + 1] in combo_lookup.
+uint16_t combo_lookup_offsets[ZMK_KEYMAP_LEN + 1];
+uint16_t combo_lookup[COMBO_KEY_COUNT];
 // combos that have been activated and still have (some) keys pressed
 // this array is always contiguous from 0.
 struct active_combo active_combos[CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS] = {NULL};
 int active_combo_count = 0;
 
-struct k_work_delayable timeout_task;
-int64_t timeout_task_timeout_at;
-
-// Store the combo key pointer in the combos array, one pointer for each key position
-// The combos are sorted shortest-first, then by virtual-key-position.
-static int initialize_combo(struct combo_cfg *new_combo) {
-    for (int i = 0; i < new_combo->key_position_len; i++) {
-        int32_t position = new_combo->key_positions[i];
-        if (position >= ZMK_KEYMAP_LEN) {
-            LOG_ERR("Unable to initialize combo, key position %d does not exist", position);
-            return -EINVAL;
+struct zmk_deadline timeout_deadline;
+
+// Fill the lookup in two passes over the combo key positions: count the combos on each position,
+// then place each combo at the next free slot of its positions.
+static void initialize_combo_lookup() {
+    for (int i = 0; i < COMBO_COUNT; i++) {
+        for (int k = 0; k < combos[i]->key_position_len; k++) {
+            combo_lookup_offsets[combos[i]->key_positions[k] + 1]++;
+        }
+    }
+    for (int p = 0; p < ZMK_KEYMAP_LEN; p++) {
+        combo_lookup_offsets[p + 1] += combo_lookup_offsets[p];
+    }
+
+    uint16_t next[ZMK_KEYMAP_LEN];
+    memcpy(next, combo_lookup_offsets, sizeof(next));
+    for (int i = 0; i < COMBO_COUNT; i++) {
+        for (int k = 0; k < combos[i]->key_position_len; k++) {
+            combo_lookup[next[combos[i]->key_positions[k]]++] = i;
         }
+    }
+}
 
-        struct combo_cfg *insert_combo = new_combo;
-        bool set = false;
-        for (int j = 0; j < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; j++) {
-            struct combo_cfg *combo_at_j = combo_lookup[position][j];
-            if (combo_at_j == NULL) {
-                combo_lookup[position][j] = insert_combo;
-                set = true;
-                break;
-            }
-            if (combo_at_j->key_position_len < insert_combo->key_position_len ||
-                (combo_at_j->key_position_len == insert_combo->key_position_len &&
-                 combo_at_j->virtual_key_position < insert_combo->virtual_key_position)) {
-                continue;
-            }
-            // put insert_combo in this spot, move all other combos up.
-            combo_lookup[position][j] = insert_combo;
-            insert_combo = combo_at_j;
+static inline bool mask_is_subset(const uint32_t *subset, const uint32_t *set, int words) {
+    for (int i = 0; i < words; i++) {
+        if (subset[i] & ~set[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void initialize_combo_data() {
+    for (int i = 0; i < COMBO_COUNT; i++) {
+        struct combo_data *data = combos[i]->data;
+        data->behavior = combos[i]->behavior;
+        if (behavior_get_binding_device(&data->behavior) == NULL) {
+            LOG_ERR("Combo behavior %s not found", log_strdup(data->behavior.behavior_dev));
         }
-        if (!set) {
-            LOG_ERR("Too many combos for key position %d, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY %d.",
-                    position, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY);
-            return -ENOMEM;
+        for (int k = 0; k < combos[i]->key_position_len; k++) {
+            int32_t position = combos[i]->key_positions[k];
+            WRITE_BIT(data->key_mask[position / 32], position % 32, true);
         }
     }
-    return 0;
 }
 
-static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
-    if (combo->layers[0] == -1) {
-        // -1 in the first layer position is global layer scope
-        return true;
+static void initialize_combo_layer_masks() {
+    for (int i = 0; i < COMBO_COUNT; i++) {
+        for (int j = 0; j < combos[i]->layers_len; j++) {
+            if (combos[i]->layers[j] == -1) {
+                // -1 is global layer scope, wherever it appears in the list
+                memset(&combo_layer_masks[i], 0xFF, sizeof(combo_layer_masks[i]));
+                break;
+            }
+            zmk_keymap_layers_state_write(&combo_layer_masks[i], combos[i]->layers[j], true);
+        }
     }
-    for (int j = 0; j < combo->layers_len; j++) {
-        if (combo->layers[j] == layer) {
+}
+
+// The layers on which a combo may be triggered right now: the highest active layer, or with
+// CONFIG_ZMK_COMBO_MATCH_ANY_ACTIVE_LAYER, every active layer.
+static void combo_trigger_layers(zmk_keymap_layers_state_t *layers) {
+#if IS_ENABLED(CONFIG_ZMK_COMBO_MATCH_ANY_ACTIVE_LAYER)
+    *layers = zmk_keymap_layer_state();
+    zmk_keymap_layers_state_write(layers, zmk_keymap_layer_default(), true);
+#else
+    *layers = (zmk_keymap_layers_state_t){0};
+    zmk_keymap_layers_state_write(layers, zmk_keymap_highest_layer_active(), true);
+#endif
+}
+
+static inline bool combo_active_on_layers(int index, const zmk_keymap_layers_state_t *layers) {
+    for (int w = 0; w < ZMK_KEYMAP_LAYERS_STATE_WORDS; w++) {
+        if (combo_layer_masks[index].words[w] & layers->words[w]) {
             return true;
         }
     }
     return false;
 }
 
-static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
-    int number_of_combo_candidates = 0;
-    uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_cfg *combo = combo_lookup[position][i];
-        if (combo == NULL) {
-            return number_of_combo_candidates;
+static int count_candidates() {
+    int count = 0;
+    for (int w = 0; w < COMBO_MASK_WORDS; w++) {
+        count += __builtin_popcount(candidates[w]);
+    }
+    return count;
+}
+
+// The first candidate is the shortest one. Of combos with the same length, the one defined first
+// in the devicetree wins.
+static const struct combo_cfg *first_candidate() {
+    const struct combo_cfg *first = NULL;
+    for (int w = 0; w < COMBO_MASK_WORDS; w++) {
+        uint32_t bits = candidates[w];
+        while (bits) {
+            const struct combo_cfg *combo = combos[w * 32 + __builtin_ctz(bits)];
+            if (first == NULL || combo->key_position_len < first->key_position_len) {
+                first = combo;
+            }
+            bits &= bits - 1;
         }
-        if (combo_active_on_layer(combo, highest_active_layer)) {
-            candidates[number_of_combo_candidates].combo = combo;
-            candidates[number_of_combo_candidates].timeout_at = timestamp + combo->timeout_ms;
-            number_of_combo_candidates++;
+    }
+    return first;
+}
+
+static void setup_candidates_on_layers(int32_t position, const zmk_keymap_layers_state_t *layers) {
+    for (int i = combo_lookup_offsets[position]; i < combo_lookup_offsets[position + 1]; i++) {
+        const uint16_t index = combo_lookup[i];
+        if (combo_active_on_layers(index, layers)) {
+            WRITE_BIT(candidates[index / 32], index % 32, true);
         }
-        // LOG_DBG("combo timeout %d %d %d", position, i, candidates[i].timeout_at);
     }
-    return number_of_combo_candidates;
+}
+
+static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
+    zmk_keymap_layers_state_t layers;
+    combo_trigger_layers(&layers);
+    setup_candidates_on_layers(position, &layers);
+    candidates_timestamp = timestamp;
+    return count_candidates();
 }
 
 static int filter_candidates(int32_t position) {
-    // this code iterates over candidates and the lookup together to filter in O(n)
-    // assuming they are both sorted on key_position_len, virtal_key_position
-    int matches = 0, lookup_idx = 0, candidate_idx = 0;
-    while (lookup_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY &&
-           candidate_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY) {
-        struct combo_cfg *candidate = candidates[candidate_idx].combo;
-        struct combo_cfg *lookup = combo_lookup[position][lookup_idx];
-        if (candidate == NULL || lookup == NULL) {
-            break;
-        }
-        if (candidate->virtual_key_position == lookup->virtual_key_position) {
-            candidates[matches] = candidates[candidate_idx];
-            matches++;
-            candidate_idx++;
-            lookup_idx++;
-        } else if (candidate->key_position_len > lookup->key_position_len) {
-            lookup_idx++;
-        } else if (candidate->key_position_len < lookup->key_position_len) {
-            candidate_idx++;
-        } else if (candidate->virtual_key_position > lookup->virtual_key_position) {
-            lookup_idx++;
-        } else if (candidate->virtual_key_position < lookup->virtual_key_position) {
-            candidate_idx++;
-        }
+    // keep the candidates which contain this position, i.e. the candidates of which the pressed
+    // keys remain a subset.
+    uint32_t on_position[COMBO_MASK_WORDS] = {0};
+    for (int i = combo_lookup_offsets[position]; i < combo_lookup_offsets[position + 1]; i++) {
+        WRITE_BIT(on_position[combo_lookup[i] / 32], combo_lookup[i] % 32, true);
     }
-    // clear unmatched candidates
-    for (int i = matches; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        candidates[i].combo = NULL;
+    for (int w = 0; w < COMBO_MASK_WORDS; w++) {
+        candidates[w] &= on_position[w];
     }
-    // LOG_DBG("combo matches after filter %d", matches);
-    return matches;
+    return count_candidates();
 }
 
 static int64_t first_candidate_timeout() {
-    int64_t first_timeout = LONG_MAX;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            break;
-        }
-        if (candidates[i].timeout_at < first_timeout) {
-            first_timeout = candidates[i].timeout_at;
+    int64_t first_timeout = LLONG_MAX;
+    for (int w = 0; w < COMBO_MASK_WORDS; w++) {
+        uint32_t bits = candidates[w];
+        while (bits) {
+            const struct combo_cfg *combo = combos[w * 32 + __builtin_ctz(bits)];
+            int64_t timeout_at = candidates_timestamp + combo->timeout_ms;
+            if (timeout_at < first_timeout) {
+                first_timeout = timeout_at;
+            }
+            bits &= bits - 1;
         }
     }
     return first_timeout;
 }
 
-static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
-    // this code assumes set(pressed_keys) <= set(candidate->key_positions)
-    // this invariant is enforced by filter_candidates
-    // since events may have been reraised after clearing one or more slots at
-    // the start of pressed_keys (see: release_pressed_keys), we have to check
-    // that each key needed to trigger the combo was pressed, not just the last.
-    for (int i = 0; i < candidate->key_position_len; i++) {
-        if (pressed_keys[i] == NULL) {
-            return false;
-        }
-    }
-    return true;
+static inline bool candidate_is_completely_pressed(const struct combo_cfg *candidate) {
+    return mask_is_subset(candidate->data->key_mask, pressed_mask, POSITION_MASK_WORDS);
 }
 
 static int cleanup();
 
 static int filter_timed_out_candidates(int64_t timestamp) {
-    int num_candidates = 0;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_candidate *candidate = &candidates[i];
-        if (candidate->combo == NULL) {
-            break;
-        }
-        if (candidate->timeout_at > timestamp) {
-            // reorder candidates so they're contiguous
-            candidates[num_candidates].combo = candidate->combo;
-            candidates[num_candidates].timeout_at = candidate->timeout_at;
-            num_candidates++;
-        } else {
-            candidate->combo = NULL;
+    for (int w = 0; w < COMBO_MASK_WORDS; w++) {
+        uint32_t bits = candidates[w];
+        while (bits) {
+            const int bit = __builtin_ctz(bits);
+            if (candidates_timestamp + combos[w * 32 + bit]->timeout_ms <= timestamp) {
+                candidates[w] &= ~BIT(bit);
+            }
+            bits &= bits - 1;
         }
     }
-    return num_candidates;
+    return count_candidates();
 }
 
 static int clear_candidates() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            return i;
-        }
-        candidates[i].combo = NULL;
-    }
-    return CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY;
+    int count = count_candidates();
+    memset(candidates, 0, sizeof(candidates));
+    return count;
 }
 
 static int capture_pressed_key(const zmk_event_t *ev) {
@@ -236,6 +311,8 @@ static int capture_pressed_key(const zmk_event_t *ev) {
             continue;
         }
         pressed_keys[i] = ev;
+        int32_t position = as_zmk_position_state_changed(ev)->position;
+        WRITE_BIT(pressed_mask[position / 32], position % 32, true);
         return ZMK_EV_EVENT_CAPTURED;
     }
     return 0;
@@ -244,12 +321,18 @@ static int capture_pressed_key(const zmk_event_t *ev) {
 const struct zmk_listener zmk_listener_combo;
 
 static int release_pressed_keys() {
+    // clear all pressed keys before reraising any of them, so the reraised events are
+    // captured in a fresh pressed_keys and pressed_mask.
+    const zmk_event_t *captured_events[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
+    memcpy(captured_events, pressed_keys, sizeof(pressed_keys));
+    memset(pressed_keys, 0, sizeof(pressed_keys));
+    memset(pressed_mask, 0, sizeof(pressed_mask));
+
     for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
-        const zmk_event_t *captured_event = pressed_keys[i];
-        if (pressed_keys[i] == NULL) {
+        const zmk_event_t *captured_event = captured_events[i];
+        if (captured_event == NULL) {
             return i;
         }
-        pressed_keys[i] = NULL;
         if (i == 0) {
             LOG_DBG("combo: releasing position event %d",
                     as_zmk_position_state_changed(captured_event)->position);
@@ -264,27 +347,31 @@ static int release_pressed_keys() {
     return CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO;
 }
 
-static inline int press_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
+static inline int press_combo_behavior(const struct combo_cfg *combo, int32_t timestamp) {
     struct zmk_behavior_binding_event event = {
         .position = combo->virtual_key_position,
         .timestamp = timestamp,
     };
 
-    return behavior_keymap_binding_pressed(&combo->behavior, event);
+    struct zmk_behavior_binding binding = combo->data->behavior;
+    return behavior_keymap_binding_pressed(&binding, event);
 }
 
-static inline int release_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
+static inline int release_combo_behavior(const struct combo_cfg *combo, int32_t timestamp) {
     struct zmk_behavior_binding_event event = {
         .position = combo->virtual_key_position,
         .timestamp = timestamp,
     };
 
-    return behavior_keymap_binding_released(&combo->behavior, event);
+    struct zmk_behavior_binding binding = combo->data->behavior;
+    return behavior_keymap_binding_released(&binding, event);
 }
 
 static void move_pressed_keys_to_active_combo(struct active_combo *active_combo) {
     int combo_length = active_combo->combo->key_position_len;
     for (int i = 0; i < combo_length; i++) {
+        int32_t position = as_zmk_position_state_changed(pressed_keys[i])->position;
+        WRITE_BIT(pressed_mask[position / 32], position % 32, false);
         active_combo->key_positions_pressed[i] = pressed_keys[i];
         pressed_keys[i] = NULL;
     }
@@ -298,7 +385,7 @@ static void move_pressed_keys_to_active_combo(struct active_combo *active_combo)
     }
 }
 
-static struct active_combo *store_active_combo(struct combo_cfg *combo) {
+static struct active_combo *store_active_combo(const struct combo_cfg *combo) {
     for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS; i++) {
         if (active_combos[i].combo == NULL) {
             active_combos[i].combo = combo;
@@ -312,7 +399,7 @@ static struct active_combo *store_active_combo(struct combo_cfg *combo) {
     return NULL;
 }
 
-static void activate_combo(struct combo_cfg *combo) {
+static void activate_combo(const struct combo_cfg *combo) {
     struct active_combo *active_combo = store_active_combo(combo);
     if (active_combo == NULL) {
         // unable to store combo
@@ -370,7 +457,7 @@ static bool release_combo_key(int32_t position, int64_t timestamp) {
 }
 
 static int cleanup() {
-    k_work_cancel_delayable(&timeout_task);
+    zmk_deadline_cancel(&timeout_deadline);
     clear_candidates();
     if (fully_pressed_combo != NULL) {
         activate_combo(fully_pressed_combo);
@@ -381,22 +468,16 @@ static int cleanup() {
 
 static void update_timeout_task() {
     int64_t first_timeout = first_candidate_timeout();
-    if (timeout_task_timeout_at == first_timeout) {
-        return;
-    }
     if (first_timeout == LLONG_MAX) {
-        timeout_task_timeout_at = 0;
-        k_work_cancel_delayable(&timeout_task);
+        zmk_deadline_cancel(&timeout_deadline);
         return;
     }
-    if (k_work_schedule(&timeout_task, K_MSEC(first_timeout - k_uptime_get())) >= 0) {
-        timeout_task_timeout_at = first_timeout;
-    }
+    zmk_deadline_schedule(&timeout_deadline, first_timeout);
 }
 
 static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
     int num_candidates;
-    if (candidates[0].combo == NULL) {
+    if (first_candidate() == NULL) {
         num_candidates = setup_candidates_for_first_keypress(data->position, data->timestamp);
         if (num_candidates == 0) {
             return 0;
@@ -407,7 +488,7 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
     }
     update_timeout_task();
 
-    struct combo_cfg *candidate_combo = candidates[0].combo;
+    const struct combo_cfg *candidate_combo = first_candidate();
     LOG_DBG("combo: capturing position event %d", data->position);
     int ret = capture_pressed_key(ev);
     switch (num_candidates) {
@@ -442,12 +523,8 @@ static int position_state_up(const zmk_event_t *ev, struct zmk_position_state_ch
     return 0;
 }
 
-static void combo_timeout_handler(struct k_work *item) {
-    if (timeout_task_timeout_at == 0 || k_uptime_get() < timeout_task_timeout_at) {
-        // timer was cancelled or rescheduled.
-        return;
-    }
-    if (filter_timed_out_candidates(timeout_task_timeout_at) < 2) {
+static void combo_timeout_handler(struct zmk_deadline *deadline) {
+    if (filter_timed_out_candidates(deadline->at) < 2) {
         cleanup();
     }
     update_timeout_task();
@@ -469,28 +546,83 @@ static int position_state_changed_listener(const zmk_event_t *ev) {
 ZMK_LISTENER(combo, position_state_changed_listener);
 ZMK_SUBSCRIPTION(combo, zmk_position_state_changed);
 
-#define COMBO_INST(n)                                                                              \
-    static struct combo_cfg combo_config_##n = {                                                   \
-        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
-        .key_positions = DT_PROP(n, key_positions),                                                \
-        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
-        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
-        .virtual_key_position = ZMK_KEYMAP_LEN + __COUNTER__,                                      \
-        .slow_release = DT_PROP(n, slow_release),                                                  \
-        .layers = DT_PROP(n, layers),                                                              \
-        .layers_len = DT_PROP_LEN(n, layers),                                                      \
-    };
+#if IS_ENABLED(CONFIG_ZMK_COMBO_BENCHMARK)
+
+// First keypress candidate setup as it was done before layer masks, by scanning each combo's
+// list of layers for the given layer.
+static void setup_candidates_on_layer_list(int32_t position, uint8_t layer) {
+    for (int i = combo_lookup_offsets[position]; i < combo_lookup_offsets[position + 1]; i++) {
+        const uint16_t index = combo_lookup[i];
+        const struct combo_cfg *combo = combos[index];
+        bool active = false;
+        for (int j = 0; !active && j < combo->layers_len; j++) {
+            active = combo->layers[j] == -1 || combo->layers[j] == layer;
+        }
+        if (active) {
+            WRITE_BIT(candidates[index / 32], index % 32, true);
+        }
+    }
+}
+
+// Times first keypress candidate setup on the position with the most combos, for each layer.
+static void combo_benchmark() {
+    int32_t position = 0;
+    for (int p = 1; p < ZMK_KEYMAP_LEN; p++) {
+        if (combo_lookup_offsets[p + 1] - combo_lookup_offsets[p] >
+            combo_lookup_offsets[position + 1] - combo_lookup_offsets[position]) {
+            position = p;
+        }
+    }
+    const int combos_on_position =
+        combo_lookup_offsets[position + 1] - combo_lookup_offsets[position];
 
-#define INITIALIZE_COMBO(n) initialize_combo(&combo_config_##n);
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        zmk_keymap_layers_state_t layers = {0};
+        zmk_keymap_layers_state_write(&layers, layer, true);
 
-DT_INST_FOREACH_CHILD(0, COMBO_INST)
+        uint32_t start = zmk_benchmark_start();
+        for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+            clear_candidates();
+            setup_candidates_on_layer_list(position, layer);
+        }
+        const uint32_t list_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+        const int list_candidates = count_candidates();
+
+        start = zmk_benchmark_start();
+        for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+            clear_candidates();
+            setup_candidates_on_layers(position, &layers);
+        }
+        const uint32_t mask_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+        const int mask_candidates = count_candidates();
+        clear_candidates();
+
+        if (list_candidates != mask_candidates) {
+            LOG_ERR("combo benchmark: layer %d: layer list found %d candidates, mask found %d",
+                    layer, list_candidates, mask_candidates);
+            continue;
+        }
+
+        LOG_INF("combo benchmark: position %d layer %d: %d of %d combos, layer list %u ns, "
+                "mask %u ns",
+                position, layer, mask_candidates, combos_on_position, list_ns, mask_ns);
+    }
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_COMBO_BENCHMARK) */
 
 static int combo_init() {
-    k_work_init_delayable(&timeout_task, combo_timeout_handler);
-    DT_INST_FOREACH_CHILD(0, INITIALIZE_COMBO);
+    zmk_deadline_init(&timeout_deadline, combo_timeout_handler);
+    initialize_combo_lookup();
+    initialize_combo_data();
+    initialize_combo_layer_masks();
+#if IS_ENABLED(CONFIG_ZMK_COMBO_BENCHMARK)
+    combo_benchmark();
+#endif
     return 0;
 }
 
-SYS_INIT(combo_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+// After the behavior devices, so their bindings can be resolved
+SYS_INIT(combo_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 
 #endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <kernel.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/deadline.h>
+#include <zmk/workqueue.h>
+
+// Scheduled deadlines, sorted by time. The list is not locked, so it may only be touched from the
+// input work queue, which also runs the handlers.
+static sys_dlist_t deadlines = SYS_DLIST_STATIC_INIT(&deadlines);
+
+#define ASSERT_ON_INPUT_WORK_Q()                                                                   \
+    __ASSERT(k_current_get() == &zmk_input_work_q()->thread,                                       \
+             "Deadlines may only be used from the input work queue")
+
+#if IS_ENABLED(CONFIG_ZMK_DEADLINE_MOCK_CLOCK)
+
+static int64_t mock_now;
+
+int64_t zmk_deadline_now(void) { return mock_now; }
+
+static void update_timer(void) {}
+
+#else
+
+static void deadline_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(deadline_work, deadline_work_handler);
+
+// Deadline the kernel timer is set for, or 0 if it is not set
+static int64_t timer_at;
+
+int64_t zmk_deadline_now(void) { return k_uptime_get(); }
+
+static void update_timer(void) {
+    struct zmk_deadline *first = SYS_DLIST_PEEK_HEAD_CONTAINER(&deadlines, first, node);
+
+    if (first == NULL) {
+        if (timer_at != 0) {
+            k_work_cancel_delayable(&deadline_work);
+            timer_at = 0;
+        }
+        return;
+    }
+
+    if (first->at == timer_at) {
+        return;
+    }
+
+    timer_at = first->at;
+    k_work_reschedule_for_queue(zmk_input_work_q(), &deadline_work,
+                                K_MSEC(MAX(first->at - k_uptime_get(), 0)));
+}
+
+#endif
+
+void zmk_deadline_init(struct zmk_deadline *deadline, zmk_deadline_handler_t handler) {
+    sys_dnode_init(&deadline->node);
+    deadline->at = 0;
+    deadline->handler = handler;
+}
+
+void zmk_deadline_schedule(struct zmk_deadline *deadline, int64_t at) {
+    ASSERT_ON_INPUT_WORK_Q();
+
+    if (zmk_deadline_is_scheduled(deadline)) {
+        sys_dlist_remove(&deadline->node);
+    }
+
+    deadline->at = at;
+
+    struct zmk_deadline *next;
+    SYS_DLIST_FOR_EACH_CONTAINER(&deadlines, next, node) {
+        if (next->at > at) {
+            sys_dlist_insert(&next->node, &deadline->node);
+            update_timer();
+            return;
+        }
+    }
+
+    sys_dlist_append(&deadlines, &deadline->node);
+    update_timer();
+}
+
+void zmk_deadline_cancel(struct zmk_deadline *deadline) {
+    ASSERT_ON_INPUT_WORK_Q();
+
+    if (zmk_deadline_is_scheduled(deadline)) {
+        sys_dlist_remove(&deadline->node);
+        update_timer();
+    }
+}
+
+// Run the handlers of all deadlines due by the given time. Handlers may schedule or cancel any
+// deadline, so the list is checked again after each one.
+static void run_due(int64_t now) {
+    struct zmk_deadline *first;
+
+    while ((first = SYS_DLIST_PEEK_HEAD_CONTAINER(&deadlines, first, node)) != NULL &&
+           first->at <= now) {
+        sys_dlist_remove(&first->node);
+#if IS_ENABLED(CONFIG_ZMK_DEADLINE_MOCK_CLOCK)
+        mock_now = MAX(mock_now, first->at);
+#endif
+        first->handler(first);
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_DEADLINE_MOCK_CLOCK)
+
+void zmk_deadline_advance(int64_t to) {
+    ASSERT_ON_INPUT_WORK_Q();
+
+    run_due(to);
+    mock_now = MAX(mock_now, to);
+}
+
+#else
+
+static void deadline_work_handler(struct k_work *work) {
+    timer_at = 0;
+    run_due(k_uptime_get());
+    update_timer();
+}
+
+#endif
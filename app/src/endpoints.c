@@ -13,6 +13,7 @@
 #include <dt-bindings/zmk/hid_usage_pages.h>
 #include <zmk/usb_hid.h>
 #include <zmk/hog.h>
+#include <zmk/latency.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/ble_active_profile_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
@@ -30,6 +31,8 @@ static enum zmk_endpoint preferred_endpoint =
 
 static void update_current_endpoint();
 
+static struct zmk_endpoints_report_stats report_stats;
+
 #if IS_ENABLED(CONFIG_SETTINGS)
 static void endpoints_save_preferred_work(struct k_work *work) {
     settings_save_one("endpoints/preferred", &preferred_endpoint, sizeof(preferred_endpoint));
@@ -71,14 +74,34 @@ int zmk_endpoints_toggle() {
     return zmk_endpoints_select(new_endpoint);
 }
 
-static int send_keyboard_report() {
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINT_MOCK)
+// Stands in for the host in tests, where neither USB nor BLE is built
+static int send_mock_report(uint16_t usage_page) {
+    LOG_DBG("usage page 0x%02X", usage_page);
+    zmk_latency_record(current_endpoint);
+    return 0;
+}
+#endif /* IS_ENABLED(CONFIG_ZMK_ENDPOINT_MOCK) */
+
+static bool keyboard_report_is_dirty() {
+#if IS_ENABLED(CONFIG_ZMK_USB)
+    if (current_endpoint == ZMK_ENDPOINT_USB) {
+        return zmk_usb_hid_keyboard_report_is_dirty();
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_USB) */
 
+    return zmk_hid_keyboard_report_is_dirty();
+}
+
+static int send_keyboard_report() {
     switch (current_endpoint) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
     case ZMK_ENDPOINT_USB: {
         int err = zmk_usb_hid_send_keyboard_report();
         if (err) {
             LOG_ERR("FAILED TO SEND OVER USB: %d", err);
+        } else {
+            zmk_latency_record(ZMK_ENDPOINT_USB);
         }
         return err;
     }
@@ -89,14 +112,20 @@ static int send_keyboard_report() {
         int err = zmk_hog_send_keyboard_report(&zmk_hid_get_keyboard_report()->body);
         if (err) {
             LOG_ERR("FAILED TO SEND OVER HOG: %d", err);
+        } else {
+            zmk_latency_record(ZMK_ENDPOINT_BLE);
         }
         return err;
     }
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
 
     default:
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINT_MOCK)
+        return send_mock_report(HID_USAGE_KEY);
+#else
         LOG_ERR("Unsupported endpoint %d", current_endpoint);
         return -ENOTSUP;
+#endif
     }
 }
 
@@ -107,6 +136,8 @@ static int send_consumer_report() {
         int err = zmk_usb_hid_send_consumer_report();
         if (err) {
             LOG_ERR("FAILED TO SEND OVER USB: %d", err);
+        } else {
+            zmk_latency_record(ZMK_ENDPOINT_USB);
         }
         return err;
     }
@@ -117,29 +148,66 @@ static int send_consumer_report() {
         int err = zmk_hog_send_consumer_report(&zmk_hid_get_consumer_report()->body);
         if (err) {
             LOG_ERR("FAILED TO SEND OVER HOG: %d", err);
+        } else {
+            zmk_latency_record(ZMK_ENDPOINT_BLE);
         }
         return err;
     }
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
 
     default:
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINT_MOCK)
+        return send_mock_report(HID_USAGE_CONSUMER);
+#else
         LOG_ERR("Unsupported endpoint %d", current_endpoint);
         return -ENOTSUP;
+#endif
     }
 }
 
+static int skip_unchanged_report(uint16_t usage_page) {
+    LOG_DBG("Skipping unchanged report for usage page 0x%02X", usage_page);
+    report_stats.suppressed++;
+    return 0;
+}
+
 int zmk_endpoints_send_report(uint16_t usage_page) {
+    int err;
 
     LOG_DBG("usage page 0x%02X", usage_page);
     switch (usage_page) {
     case HID_USAGE_KEY:
-        return send_keyboard_report();
+        if (!keyboard_report_is_dirty()) {
+            return skip_unchanged_report(usage_page);
+        }
+        err = send_keyboard_report();
+        if (!err) {
+            zmk_hid_keyboard_report_mark_sent();
+        }
+        break;
     case HID_USAGE_CONSUMER:
-        return send_consumer_report();
+        if (!zmk_hid_consumer_report_is_dirty()) {
+            return skip_unchanged_report(usage_page);
+        }
+        err = send_consumer_report();
+        if (!err) {
+            zmk_hid_consumer_report_mark_sent();
+        }
+        break;
     default:
         LOG_ERR("Unsupported usage page %d", usage_page);
         return -ENOTSUP;
     }
+
+    if (!err) {
+        report_stats.sent++;
+    }
+
+    return err;
+}
+
+void zmk_endpoints_get_report_stats(struct zmk_endpoints_report_stats *stats) {
+    *stats = report_stats;
 }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
@@ -241,12 +309,22 @@ static void update_current_endpoint() {
         current_endpoint = new_endpoint;
         LOG_INF("Endpoint changed: %d", current_endpoint);
 
+        /* The new host has not seen any of our reports yet. */
+        zmk_hid_reports_mark_unsent();
+
         ZMK_EVENT_RAISE(new_zmk_endpoint_selection_changed(
             (struct zmk_endpoint_selection_changed){.endpoint = current_endpoint}));
     }
 }
 
 static int endpoint_listener(const zmk_event_t *eh) {
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+    /* Another profile is another host, even though the endpoint stays BLE. */
+    if (as_zmk_ble_active_profile_changed(eh) != NULL) {
+        zmk_hid_reports_mark_unsent();
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
+
     update_current_endpoint();
     return 0;
 }
@@ -14,19 +14,176 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 extern struct zmk_event_type *__event_type_start[];
 extern struct zmk_event_type *__event_type_end[];
 
-extern struct zmk_event_subscription __event_subscriptions_start[];
-extern struct zmk_event_subscription __event_subscriptions_end[];
+#if IS_ENABLED(CONFIG_ZMK_EVENT_TRACE)
+
+#define TRACE_BUFFER_SIZE CONFIG_ZMK_EVENT_TRACE_BUFFER_SIZE
+
+BUILD_ASSERT(IS_POWER_OF_TWO(TRACE_BUFFER_SIZE),
+             "CONFIG_ZMK_EVENT_TRACE_BUFFER_SIZE must be a power of two");
+
+static struct zmk_event_trace_entry trace_buffer[TRACE_BUFFER_SIZE];
+// Total number of entries ever claimed. Writers claim slots atomically, so recording never locks.
+static atomic_t trace_head;
+
+static inline uint32_t trace_enter(void) { return k_cycle_get_32(); }
+
+static inline void trace_exit(const struct zmk_event_type *event_type,
+                              const struct zmk_listener *listener, int ret, uint32_t enter) {
+    uint32_t exit = k_cycle_get_32();
+    atomic_val_t index = atomic_inc(&trace_head);
+    struct zmk_event_trace_entry *entry = &trace_buffer[index & (TRACE_BUFFER_SIZE - 1)];
+
+    entry->event_type = event_type;
+    entry->listener = listener;
+    entry->enter = enter;
+    entry->exit = exit;
+    entry->ret = ret;
+}
+
+int zmk_event_trace_read(struct zmk_event_trace_entry *entries, int max_entries) {
+    atomic_val_t head = atomic_get(&trace_head);
+    int count = MIN(MIN(head, TRACE_BUFFER_SIZE), max_entries);
+
+    for (int i = 0; i < count; i++) {
+        entries[i] = trace_buffer[(head - count + i) & (TRACE_BUFFER_SIZE - 1)];
+    }
+
+    return count;
+}
+
+void zmk_event_trace_clear(void) { atomic_set(&trace_head, 0); }
+
+// Formats each recorded entry, oldest first, and hands the line to the given print callback.
+static void trace_print(void (*print)(const char *line, void *arg), void *arg) {
+    struct zmk_event_trace_entry entry;
+    char line[96];
+    atomic_val_t head = atomic_get(&trace_head);
+    int count = MIN(head, TRACE_BUFFER_SIZE);
+
+    for (int i = 0; i < count; i++) {
+        entry = trace_buffer[(head - count + i) & (TRACE_BUFFER_SIZE - 1)];
+        snprintk(line, sizeof(line), "%u %s -> %s: %d in %u ns", entry.enter,
+                 entry.event_type->name, entry.listener->name, entry.ret,
+                 k_cyc_to_ns_floor32(entry.exit - entry.enter));
+        print(line, arg);
+    }
+}
+
+static void trace_print_log(const char *line, void *arg) { LOG_INF("%s", log_strdup(line)); }
+
+void zmk_event_trace_log(void) { trace_print(trace_print_log, NULL); }
+
+#if IS_ENABLED(CONFIG_SHELL)
+#include <shell/shell.h>
+
+static void trace_print_shell(const char *line, void *arg) {
+    shell_print((const struct shell *)arg, "%s", line);
+}
+
+static int cmd_trace_dump(const struct shell *shell, size_t argc, char **argv) {
+    trace_print(trace_print_shell, (void *)shell);
+    return 0;
+}
+
+static int cmd_trace_clear(const struct shell *shell, size_t argc, char **argv) {
+    zmk_event_trace_clear();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_event_trace, SHELL_CMD(dump, NULL, "Print recorded listener calls", cmd_trace_dump),
+    SHELL_CMD(clear, NULL, "Clear recorded listener calls", cmd_trace_clear),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(event_trace, &sub_event_trace, "ZMK event manager trace", NULL);
+#endif
+
+#else
+
+static inline uint32_t trace_enter(void) { return 0; }
+
+static inline void trace_exit(const struct zmk_event_type *event_type,
+                              const struct zmk_listener *listener, int ret, uint32_t enter) {}
+
+#endif
+
+void *zmk_event_manager_alloc(const struct zmk_event_type *type, size_t size) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+    struct zmk_event_pool *pool = type->pool;
+    void *mem;
+
+    if (k_mem_slab_alloc(pool->slab, &mem, K_NO_WAIT) != 0) {
+        atomic_inc(&pool->exhausted);
+        LOG_ERR("Event pool for %s exhausted", type->name);
+        return NULL;
+    }
+
+    // Allocation does not lock, so raise the high water mark with a compare-and-swap loop in case
+    // another allocator raised it in between.
+    atomic_val_t used = k_mem_slab_num_used_get(pool->slab);
+    atomic_val_t high_water = atomic_get(&pool->high_water);
+    while (used > high_water && !atomic_cas(&pool->high_water, high_water, used)) {
+        high_water = atomic_get(&pool->high_water);
+    }
+
+    return mem;
+#else
+    void *mem = k_malloc(size);
+    if (mem == NULL) {
+        LOG_ERR("Unable to allocate %s event", type->name);
+    }
+
+    return mem;
+#endif
+}
+
+void zmk_event_manager_free(zmk_event_t *event) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+    // Captured events are released long after being raised, so find the pool from the event type
+    k_mem_slab_free(event->event->pool->slab, (void **)&event);
+#else
+    k_free(event);
+#endif
+}
+
+int zmk_event_manager_get_pool_stats(const struct zmk_event_type *type,
+                                     struct zmk_event_pool_stats *stats) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_POOL)
+    struct zmk_event_pool *pool = type->pool;
+
+    stats->size = pool->slab->num_blocks;
+    stats->used = k_mem_slab_num_used_get(pool->slab);
+    stats->high_water = atomic_get(&pool->high_water);
+    stats->exhausted = atomic_get(&pool->exhausted);
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void zmk_event_manager_log_pool_stats(void) {
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        struct zmk_event_pool_stats stats;
+        if (zmk_event_manager_get_pool_stats(*type, &stats) < 0) {
+            return;
+        }
+
+        LOG_INF("%s: %d/%d used, high water %d, exhausted %d", (*type)->name, stats.used,
+                stats.size, stats.high_water, stats.exhausted);
+    }
+}
 
 int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     int ret = 0;
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
+    const struct zmk_event_type *event_type = event->event;
+    const struct zmk_event_subscription *subs = event_type->subscriptions_start;
+    uint8_t len = event_type->subscriptions_end - subs;
     for (int i = start_index; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-        if (ev_sub->event_type != event->event) {
-            continue;
-        }
+        uint32_t enter = trace_enter();
         event->last_listener_index = i;
-        ret = ev_sub->listener->callback(event);
+        ret = subs[i].listener->callback(event);
+        trace_exit(event_type, subs[i].listener, ret, enter);
         switch (ret) {
         case ZMK_EV_EVENT_BUBBLE:
             continue;
@@ -45,35 +202,60 @@ int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     }
 
 release:
-    k_free(event);
+    zmk_event_manager_free(event);
     return ret;
 }
 
-int zmk_event_manager_raise(zmk_event_t *event) { return zmk_event_manager_handle_from(event, 0); }
+int zmk_event_manager_raise(zmk_event_t *event) {
+    if (event == NULL) {
+        return -ENOMEM;
+    }
 
-int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+    return zmk_event_manager_handle_from(event, 0);
+}
+
+static int find_listener_index(const zmk_event_t *event, const struct zmk_listener *listener) {
+    const struct zmk_event_subscription *subs = event->event->subscriptions_start;
+    uint8_t len = event->event->subscriptions_end - subs;
+
+    // Events are re-raised by the listener currently handling them or holding them captured. That
+    // is the last listener they were dispatched to, so it is found without searching.
+    if (event->last_listener_index < len && subs[event->last_listener_index].listener == listener) {
+        return event->last_listener_index;
+    }
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i + 1);
+    for (int i = 0; i < len; i++) {
+        if (subs[i].listener == listener) {
+            return i;
         }
     }
 
+    return -EINVAL;
+}
+
+int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
+    if (event == NULL) {
+        return -ENOMEM;
+    }
+
+    int index = find_listener_index(event, listener);
+    if (index >= 0) {
+        return zmk_event_manager_handle_from(event, index + 1);
+    }
+
     LOG_WRN("Unable to find where to raise this after event");
 
     return -EINVAL;
 }
 
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+    if (event == NULL) {
+        return -ENOMEM;
+    }
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i);
-        }
+    int index = find_listener_index(event, listener);
+    if (index >= 0) {
+        return zmk_event_manager_handle_from(event, index);
     }
 
     LOG_WRN("Unable to find where to raise this event");
@@ -84,3 +266,62 @@ int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *li
 int zmk_event_manager_release(zmk_event_t *event) {
     return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
 }
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_BENCHMARK)
+#include <init.h>
+#include <zmk/benchmark.h>
+
+// An event type of its own, so that the benchmark controls every listener it is dispatched to.
+struct zmk_event_benchmark {
+    uint32_t round;
+};
+
+ZMK_EVENT_DECLARE(zmk_event_benchmark);
+ZMK_EVENT_IMPL(zmk_event_benchmark);
+
+static volatile uint32_t benchmark_dispatched;
+
+static int event_benchmark_listener(const zmk_event_t *eh) {
+    benchmark_dispatched++;
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(event_benchmark, event_benchmark_listener);
+ZMK_SUBSCRIPTION(event_benchmark, zmk_event_benchmark);
+
+// Times raising events to a single no-op listener, and allocating and freeing the same events
+// without raising them, so that the difference is the dispatch cost per event.
+static int event_manager_benchmark(const struct device *_arg) {
+    const struct zmk_event_type *type = &zmk_event_zmk_event_benchmark;
+    const int listeners = type->subscriptions_end - type->subscriptions_start;
+
+    uint32_t start = zmk_benchmark_start();
+    for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+        ZMK_EVENT_FREE(new_zmk_event_benchmark((struct zmk_event_benchmark){.round = i}));
+    }
+    const uint32_t alloc_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+
+    benchmark_dispatched = 0;
+    start = zmk_benchmark_start();
+    for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+        ZMK_EVENT_RAISE(new_zmk_event_benchmark((struct zmk_event_benchmark){.round = i}));
+    }
+    const uint32_t raise_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+
+    if (benchmark_dispatched != ZMK_BENCHMARK_ROUNDS * listeners) {
+        LOG_ERR("event manager benchmark: %d events reached the listener %d times",
+                ZMK_BENCHMARK_ROUNDS, benchmark_dispatched);
+        return 0;
+    }
+
+    LOG_INF("event manager benchmark: %d events dispatched to %d listener", ZMK_BENCHMARK_ROUNDS,
+            listeners);
+    LOG_INF("event manager benchmark: raise %u ns, allocate and free %u ns, dispatch %u ns",
+            raise_ns, alloc_ns, raise_ns > alloc_ns ? raise_ns - alloc_ns : 0);
+
+    return 0;
+}
+
+SYS_INIT(event_manager_benchmark, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_BENCHMARK) */
@@ -5,10 +5,13 @@
  */
 
 #include "zmk/keys.h"
+#include <init.h>
+#include <kernel.h>
 #include <logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/hid.h>
+#include <zmk/benchmark.h>
 #include <dt-bindings/zmk/modifiers.h>
 
 static struct zmk_hid_keyboard_report keyboard_report = {
@@ -24,6 +27,21 @@ static uint8_t keys_held = 0;
 
 #endif /* IS_ENABLED(CONFIG_ZMK_USB_BOOT) */
 
+// Report bodies as last sent to the host, so that unchanged reports need not be sent again.
+// The dirty flags are set by every mutation and spare the comparison when nothing was touched.
+static struct zmk_hid_keyboard_report_body sent_keyboard_body;
+static struct zmk_hid_consumer_report_body sent_consumer_body;
+static bool keyboard_dirty = false;
+static bool consumer_dirty = false;
+
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+static zmk_hid_boot_report_t sent_boot_report;
+#endif
+
+// Set when the host may not hold the last sent reports, e.g. after an endpoint change.
+static bool keyboard_resync = false;
+static bool consumer_resync = false;
+
 // Keep track of how often a modifier was pressed.
 // Only release the modifier if the count is 0.
 static int explicit_modifier_counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
@@ -34,6 +52,7 @@ static zmk_mod_flags_t masked_modifiers = 0;
 #define SET_MODIFIERS(mods)                                                                        \
     {                                                                                              \
         keyboard_report.body.modifiers = (mods & ~masked_modifiers) | implicit_modifiers;          \
+        keyboard_dirty = true;                                                                     \
         LOG_DBG("Modifiers set to 0x%02X", keyboard_report.body.modifiers);                        \
     }
 
@@ -108,30 +127,61 @@ static zmk_hid_boot_report_t *boot_report_rollover(uint8_t modifiers) {
 
 #define TOGGLE_KEYBOARD(code, val) WRITE_BIT(keyboard_report.body.keys[code / 8], code % 8, val)
 
-#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
-zmk_hid_boot_report_t *zmk_hid_get_boot_report() {
-    if (keys_held > HID_BOOT_KEY_LEN) {
-        return boot_report_rollover(keyboard_report.body.modifiers);
+static inline bool check_keyboard_usage(zmk_key_t usage) {
+    if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
+        return false;
     }
+    return keyboard_report.body.keys[usage / 8] & (1 << (usage % 8));
+}
 
-    boot_report.modifiers = keyboard_report.body.modifiers;
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+
+// While no more than HID_BOOT_KEY_LEN keys are held, the boot report keys are kept up to date as
+// keys are selected and deselected, packed at the start of the array in press order. In rollover
+// they are left stale and refilled from the bitmap once enough keys are released.
+
+static void boot_report_rebuild() {
     memset(&boot_report.keys, 0, HID_BOOT_KEY_LEN);
     int ix = 0;
-    uint8_t base_code = 0;
-    for (int i = 0; i < (ZMK_HID_KEYBOARD_NKRO_MAX_USAGE + 1) / 8; ++i) {
-        if (ix == keys_held) {
-            break;
+    for (int i = 0; i < sizeof(keyboard_report.body.keys) && ix < HID_BOOT_KEY_LEN; i++) {
+        uint8_t bits = keyboard_report.body.keys[i];
+        while (bits && ix < HID_BOOT_KEY_LEN) {
+            boot_report.keys[ix++] = i * 8 + __builtin_ctz(bits);
+            bits &= bits - 1;
         }
-        if (!keyboard_report.body.keys[i]) {
-            continue;
+    }
+}
+
+static void boot_report_add(zmk_key_t usage) {
+    if (keys_held <= HID_BOOT_KEY_LEN) {
+        boot_report.keys[keys_held - 1] = usage;
+    }
+}
+
+static void boot_report_remove(zmk_key_t usage) {
+    if (keys_held >= HID_BOOT_KEY_LEN) {
+        if (keys_held == HID_BOOT_KEY_LEN) {
+            boot_report_rebuild();
         }
-        base_code = i * 8;
-        for (int j = 0; j < 8; ++j) {
-            if (keyboard_report.body.keys[i] & BIT(j)) {
-                boot_report.keys[ix++] = base_code + j;
-            }
+        return;
+    }
+
+    // Move the last key into the freed slot to keep the keys packed.
+    for (int i = 0; i < keys_held; i++) {
+        if (boot_report.keys[i] == usage) {
+            boot_report.keys[i] = boot_report.keys[keys_held];
+            break;
         }
     }
+    boot_report.keys[keys_held] = 0;
+}
+
+zmk_hid_boot_report_t *zmk_hid_get_boot_report() {
+    if (keys_held > HID_BOOT_KEY_LEN) {
+        return boot_report_rollover(keyboard_report.body.modifiers);
+    }
+
+    boot_report.modifiers = keyboard_report.body.modifiers;
     return &boot_report;
 }
 #endif
@@ -140,9 +190,13 @@ static inline int select_keyboard_usage(zmk_key_t usage) {
     if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
         return -EINVAL;
     }
+    if (check_keyboard_usage(usage)) {
+        return 0;
+    }
     TOGGLE_KEYBOARD(usage, 1);
 #if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
     ++keys_held;
+    boot_report_add(usage);
 #endif
     return 0;
 }
@@ -151,20 +205,17 @@ static inline int deselect_keyboard_usage(zmk_key_t usage) {
     if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
         return -EINVAL;
     }
+    if (!check_keyboard_usage(usage)) {
+        return 0;
+    }
     TOGGLE_KEYBOARD(usage, 0);
 #if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
     --keys_held;
+    boot_report_remove(usage);
 #endif
     return 0;
 }
 
-static inline bool check_keyboard_usage(zmk_key_t usage) {
-    if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
-        return false;
-    }
-    return keyboard_report.body.keys[usage / 8] & (1 << (usage % 8));
-}
-
 #elif IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_HKRO)
 
 #define TOGGLE_KEYBOARD(match, val)                                                                \
@@ -286,6 +337,7 @@ int zmk_hid_keyboard_press(zmk_key_t code) {
         return zmk_hid_register_mod(code - HID_USAGE_KEY_KEYBOARD_LEFTCONTROL);
     }
     select_keyboard_usage(code);
+    keyboard_dirty = true;
     return 0;
 };
 
@@ -294,6 +346,7 @@ int zmk_hid_keyboard_release(zmk_key_t code) {
         return zmk_hid_unregister_mod(code - HID_USAGE_KEY_KEYBOARD_LEFTCONTROL);
     }
     deselect_keyboard_usage(code);
+    keyboard_dirty = true;
     return 0;
 };
 
@@ -304,19 +357,31 @@ bool zmk_hid_keyboard_is_pressed(zmk_key_t code) {
     return check_keyboard_usage(code);
 }
 
-void zmk_hid_keyboard_clear() { memset(&keyboard_report.body, 0, sizeof(keyboard_report.body)); }
+void zmk_hid_keyboard_clear() {
+    memset(&keyboard_report.body, 0, sizeof(keyboard_report.body));
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+    keys_held = 0;
+    memset(&boot_report.keys, 0, HID_BOOT_KEY_LEN);
+#endif
+    keyboard_dirty = true;
+}
 
 int zmk_hid_consumer_press(zmk_key_t code) {
     TOGGLE_CONSUMER(0U, code);
+    consumer_dirty = true;
     return 0;
 };
 
 int zmk_hid_consumer_release(zmk_key_t code) {
     TOGGLE_CONSUMER(code, 0U);
+    consumer_dirty = true;
     return 0;
 };
 
-void zmk_hid_consumer_clear() { memset(&consumer_report.body, 0, sizeof(consumer_report.body)); }
+void zmk_hid_consumer_clear() {
+    memset(&consumer_report.body, 0, sizeof(consumer_report.body));
+    consumer_dirty = true;
+}
 
 bool zmk_hid_consumer_is_pressed(zmk_key_t key) {
     for (int idx = 0; idx < CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE; idx++) {
@@ -364,3 +429,192 @@ struct zmk_hid_keyboard_report *zmk_hid_get_keyboard_report() {
 struct zmk_hid_consumer_report *zmk_hid_get_consumer_report() {
     return &consumer_report;
 }
+
+bool zmk_hid_keyboard_report_is_dirty() {
+    if (!keyboard_dirty) {
+        return false;
+    }
+    if (keyboard_resync ||
+        memcmp(&keyboard_report.body, &sent_keyboard_body, sizeof(sent_keyboard_body)) != 0) {
+        return true;
+    }
+    keyboard_dirty = false;
+    return false;
+}
+
+void zmk_hid_keyboard_report_mark_sent() {
+    sent_keyboard_body = keyboard_report.body;
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+    // Both protocols describe the same key state, so keep their copies in step.
+    sent_boot_report = *zmk_hid_get_boot_report();
+#endif
+    keyboard_dirty = false;
+    keyboard_resync = false;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+bool zmk_hid_boot_report_is_dirty() {
+    if (!keyboard_dirty) {
+        return false;
+    }
+    // The keyboard report may still differ when only keys past the boot rollover changed,
+    // so leave its dirty flag alone.
+    return keyboard_resync ||
+           memcmp(zmk_hid_get_boot_report(), &sent_boot_report, sizeof(sent_boot_report)) != 0;
+}
+#endif /* IS_ENABLED(CONFIG_ZMK_USB_BOOT) */
+
+bool zmk_hid_consumer_report_is_dirty() {
+    if (!consumer_dirty) {
+        return false;
+    }
+    if (consumer_resync ||
+        memcmp(&consumer_report.body, &sent_consumer_body, sizeof(sent_consumer_body)) != 0) {
+        return true;
+    }
+    consumer_dirty = false;
+    return false;
+}
+
+void zmk_hid_consumer_report_mark_sent() {
+    sent_consumer_body = consumer_report.body;
+    consumer_dirty = false;
+    consumer_resync = false;
+}
+
+void zmk_hid_reports_mark_unsent() {
+    keyboard_dirty = true;
+    consumer_dirty = true;
+    keyboard_resync = true;
+    consumer_resync = true;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_HID_BENCHMARK)
+
+#define BENCHMARK_REPORT_TYPE                                                                      \
+    COND_CODE_1(IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO), ("NKRO"), ("HKRO"))
+
+static const uint8_t benchmark_held_keys[] = {1, 6, 10};
+
+static volatile uint8_t benchmark_sink;
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO) && IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+
+// Offsets from HID_USAGE_KEY_KEYBOARD_A, negated for a release. Keys go down out of usage order,
+// overflow the boot report and come back below HID_BOOT_KEY_LEN before all are released.
+static const int8_t boot_check_steps[] = {4,   1,  10, 3, -1, 8,  2,  6,  5,  9,
+                                          -10, -3, -5, 1, -8, -6, -2, -4, -9, -1};
+
+static bool boot_keys_contained(const zmk_hid_boot_report_t *a, const zmk_hid_boot_report_t *b) {
+    for (int i = 0; i < HID_BOOT_KEY_LEN; i++) {
+        bool found = false;
+        for (int j = 0; j < HID_BOOT_KEY_LEN && !found; j++) {
+            found = a->keys[i] == b->keys[j];
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks the incrementally kept boot report against a rebuild from the bitmap after each change.
+// The kept report is in press order, so only the set of keys is compared.
+static void hid_boot_report_check() {
+    for (int i = 0; i < ARRAY_SIZE(boot_check_steps); i++) {
+        const int8_t step = boot_check_steps[i];
+        if (step > 0) {
+            zmk_hid_keyboard_press(HID_USAGE_KEY_KEYBOARD_A + step);
+        } else {
+            zmk_hid_keyboard_release(HID_USAGE_KEY_KEYBOARD_A - step);
+        }
+
+        if (keys_held > HID_BOOT_KEY_LEN) {
+            continue;
+        }
+
+        const zmk_hid_boot_report_t kept = *zmk_hid_get_boot_report();
+        boot_report_rebuild();
+        const zmk_hid_boot_report_t rebuilt = boot_report;
+        boot_report = kept;
+
+        if (!boot_keys_contained(&kept, &rebuilt) || !boot_keys_contained(&rebuilt, &kept)) {
+            LOG_ERR("hid benchmark: boot report differs from a rebuild after change %d", i);
+            zmk_hid_keyboard_clear();
+            return;
+        }
+    }
+
+    LOG_INF("hid benchmark: boot report matches a rebuild after %d changes",
+            (int)ARRAY_SIZE(boot_check_steps));
+    zmk_hid_keyboard_clear();
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO) && IS_ENABLED(CONFIG_ZMK_USB_BOOT) */
+
+// Times tapping one more key and fetching the report after each change, with some keys held.
+static int hid_benchmark(const struct device *_arg) {
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO) && IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+    hid_boot_report_check();
+#endif
+
+    for (int k = 0; k < ARRAY_SIZE(benchmark_held_keys); k++) {
+        const int held = benchmark_held_keys[k];
+        const zmk_key_t extra = HID_USAGE_KEY_KEYBOARD_A + held;
+
+        for (int i = 0; i < held; i++) {
+            zmk_hid_keyboard_press(HID_USAGE_KEY_KEYBOARD_A + i);
+        }
+
+        uint32_t start = zmk_benchmark_start();
+        for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+            zmk_hid_keyboard_press(extra);
+            benchmark_sink ^= zmk_hid_get_keyboard_report()->body.keys[0];
+            zmk_hid_keyboard_release(extra);
+            benchmark_sink ^= zmk_hid_get_keyboard_report()->body.keys[0];
+        }
+        LOG_INF("hid benchmark: %s keyboard report with %d keys held: %u ns",
+                BENCHMARK_REPORT_TYPE, held, zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS));
+
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+        start = zmk_benchmark_start();
+        for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+            zmk_hid_keyboard_press(extra);
+            benchmark_sink ^= zmk_hid_get_boot_report()->keys[0];
+            zmk_hid_keyboard_release(extra);
+            benchmark_sink ^= zmk_hid_get_boot_report()->keys[0];
+        }
+        LOG_INF("hid benchmark: %s boot report with %d keys held: %u ns", BENCHMARK_REPORT_TYPE,
+                held, zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS));
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
+        // Keys were pressed in usage order, so the kept report matches a rebuild byte for byte.
+        zmk_hid_boot_report_t kept = *zmk_hid_get_boot_report();
+
+        start = zmk_benchmark_start();
+        for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+            zmk_hid_keyboard_press(extra);
+            boot_report_rebuild();
+            zmk_hid_keyboard_release(extra);
+            boot_report_rebuild();
+        }
+        const uint32_t rebuild_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+
+        if (memcmp(&kept, zmk_hid_get_boot_report(), sizeof(kept)) != 0) {
+            LOG_ERR("hid benchmark: kept boot report differs from rebuild with %d keys held",
+                    held);
+        }
+        LOG_INF("hid benchmark: %s boot report rebuild with %d keys held: %u ns",
+                BENCHMARK_REPORT_TYPE, held, rebuild_ns);
+#endif /* IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO) */
+#endif /* IS_ENABLED(CONFIG_ZMK_USB_BOOT) */
+
+        zmk_hid_keyboard_clear();
+    }
+
+    return 0;
+}
+
+SYS_INIT(hid_benchmark, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_HID_BENCHMARK) */
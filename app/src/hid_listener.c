@@ -15,59 +15,147 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/hid.h>
 #include <dt-bindings/zmk/hid_usage_pages.h>
 #include <zmk/endpoints.h>
+#include <zmk/workqueue.h>
+#include <zmk/latency.h>
+
+#if IS_ENABLED(CONFIG_ZMK_HID_REPORT_COALESCING)
+
+#define PENDING_USAGES_LEN 16
+
+// Usages changed since reports were last flushed. A second change to one of them must not be
+// merged with the first, or the host would never see the state in between.
+static uint32_t pending_usages[PENDING_USAGES_LEN];
+static uint8_t pending_usages_len = 0;
+// Set once a non-modifier key was pressed since the last flush. A later modifier change must not
+// be merged into the same report, or the host would apply it to keys pressed before it.
+static bool pending_key_presses = false;
+static bool keyboard_report_pending = false;
+static bool consumer_report_pending = false;
+
+static void flush_reports() {
+    pending_usages_len = 0;
+    pending_key_presses = false;
+
+    if (keyboard_report_pending) {
+        keyboard_report_pending = false;
+        int err = zmk_endpoints_send_report(HID_USAGE_KEY);
+        if (err < 0) {
+            LOG_ERR("Failed to send coalesced key report (%d)", err);
+        }
+    }
+
+    if (consumer_report_pending) {
+        consumer_report_pending = false;
+        int err = zmk_endpoints_send_report(HID_USAGE_CONSUMER);
+        if (err < 0) {
+            LOG_ERR("Failed to send coalesced consumer report (%d)", err);
+        }
+    }
+
+    zmk_latency_end_deferred();
+}
+
+static void flush_reports_work_handler(struct k_work *work) { flush_reports(); }
+
+static K_WORK_DELAYABLE_DEFINE(flush_reports_work, flush_reports_work_handler);
+
+static void coalesce_change(const struct zmk_keycode_state_changed *ev) {
+    uint32_t usage = ZMK_HID_USAGE(ev->usage_page, ev->keycode);
+    bool mod_key = is_mod(ev->usage_page, ev->keycode);
+    bool changes_mods = mod_key || ev->explicit_modifiers || ev->implicit_modifiers;
+
+    bool flush = pending_usages_len == PENDING_USAGES_LEN || (changes_mods && pending_key_presses);
+    for (int i = 0; !flush && i < pending_usages_len; i++) {
+        flush = pending_usages[i] == usage;
+    }
+
+    if (flush) {
+        LOG_DBG("Flushing reports before usage 0x%08X changes", usage);
+        flush_reports();
+    }
+
+    pending_usages[pending_usages_len++] = usage;
+    if (ev->state && !mod_key) {
+        pending_key_presses = true;
+    }
+}
+
+static int send_reports(uint16_t usage_page) {
+    // Modifiers live in the keyboard report, so events on other pages may have changed it too.
+    keyboard_report_pending = true;
+    if (usage_page == HID_USAGE_CONSUMER) {
+        consumer_report_pending = true;
+    }
+
+    // The report goes out after the keymap is done with this key position change, so keep its
+    // latency pending until the flush.
+    zmk_latency_defer();
+
+    // Queued behind the work item raising this event, so by default every change made in the
+    // same pass of the input work queue goes out together.
+    k_work_schedule_for_queue(zmk_input_work_q(), &flush_reports_work,
+                              K_USEC(CONFIG_ZMK_HID_REPORT_COALESCING_WINDOW_US));
+    return 0;
+}
+
+#else
+
+static int send_reports(uint16_t usage_page) {
+    // Modifiers live in the keyboard report, so events on other pages may have changed it too.
+    // Unchanged reports are skipped by the endpoints, so this only sends what the host lacks.
+    if (usage_page != HID_USAGE_KEY) {
+        int err = zmk_endpoints_send_report(HID_USAGE_KEY);
+        if (err < 0) {
+            LOG_ERR("Failed to send key report for changed mofifiers for consumer page event (%d)",
+                    err);
+        }
+    }
+
+    return zmk_endpoints_send_report(usage_page);
+}
+
+static inline void coalesce_change(const struct zmk_keycode_state_changed *ev) {}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_HID_REPORT_COALESCING) */
 
 static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *ev) {
-    int err, explicit_mods_changed, implicit_mods_changed;
+    int err;
 
     LOG_DBG("usage_page 0x%02X keycode 0x%02X implicit_mods 0x%02X explicit_mods 0x%02X",
             ev->usage_page, ev->keycode, ev->implicit_modifiers, ev->explicit_modifiers);
+    coalesce_change(ev);
     err = zmk_hid_press(ZMK_HID_USAGE(ev->usage_page, ev->keycode));
     if (err < 0) {
         LOG_DBG("Unable to press keycode");
         return err;
     }
-    explicit_mods_changed = zmk_hid_register_mods(ev->explicit_modifiers);
-    implicit_mods_changed = zmk_hid_implicit_modifiers_press(ev->implicit_modifiers);
-    if (ev->usage_page != HID_USAGE_KEY &&
-        (explicit_mods_changed > 0 || implicit_mods_changed > 0)) {
-        err = zmk_endpoints_send_report(HID_USAGE_KEY);
-        if (err < 0) {
-            LOG_ERR("Failed to send key report for changed mofifiers for consumer page event (%d)",
-                    err);
-        }
-    }
+    zmk_hid_register_mods(ev->explicit_modifiers);
+    zmk_hid_implicit_modifiers_press(ev->implicit_modifiers);
 
-    return zmk_endpoints_send_report(ev->usage_page);
+    return send_reports(ev->usage_page);
 }
 
 static int hid_listener_keycode_released(const struct zmk_keycode_state_changed *ev) {
-    int err, explicit_mods_changed, implicit_mods_changed;
+    int err;
 
     LOG_DBG("usage_page 0x%02X keycode 0x%02X implicit_mods 0x%02X explicit_mods 0x%02X",
             ev->usage_page, ev->keycode, ev->implicit_modifiers, ev->explicit_modifiers);
+    coalesce_change(ev);
     err = zmk_hid_release(ZMK_HID_USAGE(ev->usage_page, ev->keycode));
     if (err < 0) {
         LOG_DBG("Unable to release keycode");
         return err;
     }
 
-    explicit_mods_changed = zmk_hid_unregister_mods(ev->explicit_modifiers);
+    zmk_hid_unregister_mods(ev->explicit_modifiers);
     // There is a minor issue with this code.
     // If LC(A) is pressed, then LS(B), then LC(A) is released, the shift for B will be released
     // prematurely. This causes if LS(B) to repeat like Bbbbbbbb when pressed for a long time.
     // Solving this would require keeping track of which key's implicit modifiers are currently
     // active and only releasing modifiers at that time.
-    implicit_mods_changed = zmk_hid_implicit_modifiers_release();
-    ;
-    if (ev->usage_page != HID_USAGE_KEY &&
-        (explicit_mods_changed > 0 || implicit_mods_changed > 0)) {
-        err = zmk_endpoints_send_report(HID_USAGE_KEY);
-        if (err < 0) {
-            LOG_ERR("Failed to send key report for changed mofifiers for consumer page event (%d)",
-                    err);
-        }
-    }
-    return zmk_endpoints_send_report(ev->usage_page);
+    zmk_hid_implicit_modifiers_release();
+
+    return send_reports(ev->usage_page);
 }
 
 int hid_listener(const zmk_event_t *eh) {
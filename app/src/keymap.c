@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <init.h>
 #include <sys/util.h>
 #include <bluetooth/bluetooth.h>
 #include <logging/log.h>
@@ -16,6 +17,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/behavior.h>
 
 #include <zmk/ble.h>
+#include <zmk/latency.h>
 #if ZMK_BLE_IS_CENTRAL
 #include <zmk/split/bluetooth/central.h>
 #endif
@@ -25,29 +27,116 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/events/layer_state_changed.h>
 #include <zmk/events/sensor_event.h>
 
-static zmk_keymap_layers_state_t _zmk_keymap_layer_state = 0;
+static zmk_keymap_layers_state_t _zmk_keymap_layer_state = {0};
 static uint8_t _zmk_keymap_layer_default = 0;
 
 #define DT_DRV_COMPAT zmk_keymap
 
-#define LAYER_CHILD_LEN(node) 1 +
 #define ZMK_KEYMAP_NODE DT_DRV_INST(0)
-#define ZMK_KEYMAP_LAYERS_LEN (DT_INST_FOREACH_CHILD(0, LAYER_CHILD_LEN) 0)
 
-#define BINDING_WITH_COMMA(idx, drv_inst) ZMK_KEYMAP_EXTRACT_BINDING(idx, drv_inst),
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_COMPACT)
+
+// Behaviors a compact binding can refer to are the labeled children of the root, /behaviors and
+// /macros nodes. Each one gets a dense index through this enum, so a binding only needs to store
+// that index and the behavior's label and device are looked up from the tables below.
+#define COMPACT_BEHAVIOR_ID(node) UTIL_CAT(ZMK_KEYMAP_BEHAVIOR_, node)
+
+#define COMPACT_BEHAVIOR_ENUM(node)                                                                \
+    COND_CODE_1(DT_NODE_HAS_PROP(node, label), (COMPACT_BEHAVIOR_ID(node), ), ())
+
+#define COMPACT_BEHAVIOR_LABEL(node)                                                               \
+    COND_CODE_1(DT_NODE_HAS_PROP(node, label), ([COMPACT_BEHAVIOR_ID(node)] = DT_LABEL(node), ), ())
+
+#if DT_NODE_EXISTS(DT_PATH(behaviors))
+#define FOREACH_BEHAVIORS_CHILD(fn) DT_FOREACH_CHILD(DT_PATH(behaviors), fn)
+#else
+#define FOREACH_BEHAVIORS_CHILD(fn)
+#endif
+
+#if DT_NODE_EXISTS(DT_PATH(macros))
+#define FOREACH_MACROS_CHILD(fn) DT_FOREACH_CHILD(DT_PATH(macros), fn)
+#else
+#define FOREACH_MACROS_CHILD(fn)
+#endif
+
+#define FOREACH_COMPACT_BEHAVIOR(fn)                                                               \
+    DT_FOREACH_CHILD(DT_ROOT, fn) FOREACH_BEHAVIORS_CHILD(fn) FOREACH_MACROS_CHILD(fn)
+
+enum zmk_keymap_behavior_id {
+    FOREACH_COMPACT_BEHAVIOR(COMPACT_BEHAVIOR_ENUM) ZMK_KEYMAP_BEHAVIORS_LEN
+};
+
+BUILD_ASSERT(ZMK_KEYMAP_BEHAVIORS_LEN <= UINT16_MAX, "Too many behaviors for a compact keymap");
+
+static char *const zmk_keymap_behavior_labels[ZMK_KEYMAP_BEHAVIORS_LEN] = {
+    FOREACH_COMPACT_BEHAVIOR(COMPACT_BEHAVIOR_LABEL)};
+
+// Filled in at init for every behavior the keymap refers to
+static const struct device *zmk_keymap_behavior_devices[ZMK_KEYMAP_BEHAVIORS_LEN];
+
+struct zmk_keymap_compact_binding {
+    uint32_t param1;
+    uint32_t param2;
+    uint16_t behavior;
+};
+
+typedef const struct zmk_keymap_compact_binding zmk_keymap_entry_t;
+
+#define EXTRACT_ENTRY(idx, node, prop)                                                             \
+    {                                                                                              \
+        .behavior = COMPACT_BEHAVIOR_ID(DT_PHANDLE_BY_IDX(node, prop, idx)),                       \
+        .param1 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(node, prop, idx, param1), (0),                \
+                              (DT_PHA_BY_IDX(node, prop, idx, param1))),                           \
+        .param2 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(node, prop, idx, param2), (0),                \
+                              (DT_PHA_BY_IDX(node, prop, idx, param2))),                           \
+    }
+
+static inline void resolve_entry(zmk_keymap_entry_t *entry) {
+    if (zmk_keymap_behavior_devices[entry->behavior] == NULL) {
+        zmk_keymap_behavior_devices[entry->behavior] =
+            device_get_binding(zmk_keymap_behavior_labels[entry->behavior]);
+    }
+}
+
+static inline void decode_entry(zmk_keymap_entry_t *entry, struct zmk_behavior_binding *binding) {
+    resolve_entry(entry);
+    *binding = (struct zmk_behavior_binding){
+        .behavior_dev = zmk_keymap_behavior_labels[entry->behavior],
+        .behavior = zmk_keymap_behavior_devices[entry->behavior],
+        .param1 = entry->param1,
+        .param2 = entry->param2,
+    };
+}
+
+#else
+
+typedef struct zmk_behavior_binding zmk_keymap_entry_t;
+
+#define EXTRACT_ENTRY(idx, node, prop)                                                             \
+    {                                                                                              \
+        .behavior_dev = DT_LABEL(DT_PHANDLE_BY_IDX(node, prop, idx)),                              \
+        .param1 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(node, prop, idx, param1), (0),                \
+                              (DT_PHA_BY_IDX(node, prop, idx, param1))),                           \
+        .param2 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(node, prop, idx, param2), (0),                \
+                              (DT_PHA_BY_IDX(node, prop, idx, param2))),                           \
+    }
+
+static inline void resolve_entry(zmk_keymap_entry_t *entry) { behavior_get_binding_device(entry); }
+
+static inline void decode_entry(zmk_keymap_entry_t *entry, struct zmk_behavior_binding *binding) {
+    resolve_entry(entry);
+    *binding = *entry;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_COMPACT) */
+
+#define BINDING_WITH_COMMA(idx, node) EXTRACT_ENTRY(idx, node, bindings),
 
 #define TRANSFORMED_LAYER(node)                                                                    \
     {UTIL_LISTIFY(DT_PROP_LEN(node, bindings), BINDING_WITH_COMMA, node)},
 
 #if ZMK_KEYMAP_HAS_SENSORS
-#define _TRANSFORM_SENSOR_ENTRY(idx, layer)                                                        \
-    {                                                                                              \
-        .behavior_dev = DT_LABEL(DT_PHANDLE_BY_IDX(layer, sensor_bindings, idx)),                  \
-        .param1 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(layer, sensor_bindings, idx, param1), (0),    \
-                              (DT_PHA_BY_IDX(layer, sensor_bindings, idx, param1))),               \
-        .param2 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(layer, sensor_bindings, idx, param2), (0),    \
-                              (DT_PHA_BY_IDX(layer, sensor_bindings, idx, param2))),               \
-    },
+#define _TRANSFORM_SENSOR_ENTRY(idx, layer) EXTRACT_ENTRY(idx, layer, sensor_bindings),
 
 #define SENSOR_LAYER(node)                                                                         \
     COND_CODE_1(                                                                                   \
@@ -64,9 +153,9 @@ static uint8_t _zmk_keymap_layer_default = 0;
 // When a behavior handles a key position "down" event, we record the layer state
 // here so that even if that layer is deactivated before the "up", event, we
 // still send the release event to the behavior in that layer also.
-static uint32_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
+static zmk_keymap_layers_state_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
 
-static struct zmk_behavior_binding zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
+static zmk_keymap_entry_t zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
     DT_INST_FOREACH_CHILD(0, TRANSFORMED_LAYER)};
 
 static const char *zmk_keymap_layer_names[ZMK_KEYMAP_LAYERS_LEN] = {
@@ -74,12 +163,47 @@ static const char *zmk_keymap_layer_names[ZMK_KEYMAP_LAYERS_LEN] = {
 
 #if ZMK_KEYMAP_HAS_SENSORS
 
-static struct zmk_behavior_binding zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN]
-                                                    [ZMK_KEYMAP_SENSORS_LEN] = {
-                                                        DT_INST_FOREACH_CHILD(0, SENSOR_LAYER)};
+static zmk_keymap_entry_t zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_SENSORS_LEN] = {
+    DT_INST_FOREACH_CHILD(0, SENSOR_LAYER)};
 
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+// For each position, the highest layer that is active in the current layer state and does not
+// have a transparent binding there. Presses start dispatching from this layer, so transparent
+// fall-through is resolved when the layer state changes rather than on every key press.
+static uint8_t zmk_keymap_effective_layer[ZMK_KEYMAP_LEN];
+
+static bool is_transparent(uint8_t layer, uint32_t position) {
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_transparent)
+    struct zmk_behavior_binding binding;
+    decode_entry(&zmk_keymap[layer][position], &binding);
+    return binding.behavior == DEVICE_DT_GET(DT_INST(0, zmk_behavior_transparent));
+#else
+    return false;
+#endif
+}
+
+static uint8_t find_effective_layer(uint32_t position, int top) {
+    for (int layer = top; layer > _zmk_keymap_layer_default; layer--) {
+        if (zmk_keymap_layer_active(layer) && !is_transparent(layer, position)) {
+            return layer;
+        }
+    }
+    return _zmk_keymap_layer_default;
+}
+
+static void update_effective_layers(uint8_t layer, bool state) {
+    for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        if (state) {
+            if (layer > zmk_keymap_effective_layer[position] && !is_transparent(layer, position)) {
+                zmk_keymap_effective_layer[position] = layer;
+            }
+        } else if (zmk_keymap_effective_layer[position] == layer) {
+            zmk_keymap_effective_layer[position] = find_effective_layer(position, layer - 1);
+        }
+    }
+}
+
 static inline int set_layer_state(uint8_t layer, bool state) {
     if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
         return -EINVAL;
@@ -90,11 +214,11 @@ static inline int set_layer_state(uint8_t layer, bool state) {
         return 0;
     }
 
-    zmk_keymap_layers_state_t old_state = _zmk_keymap_layer_state;
-    WRITE_BIT(_zmk_keymap_layer_state, layer, state);
     // Don't send state changes unless there was an actual change
-    if (old_state != _zmk_keymap_layer_state) {
+    if (zmk_keymap_layers_state_test(&_zmk_keymap_layer_state, layer) != state) {
+        zmk_keymap_layers_state_write(&_zmk_keymap_layer_state, layer, state);
         LOG_DBG("layer_changed: layer %d state %d", layer, state);
+        update_effective_layers(layer, state);
         ZMK_EVENT_RAISE(create_layer_state_changed(layer, state));
     }
 
@@ -105,23 +229,20 @@ uint8_t zmk_keymap_layer_default() { return _zmk_keymap_layer_default; }
 
 zmk_keymap_layers_state_t zmk_keymap_layer_state() { return _zmk_keymap_layer_state; }
 
-bool zmk_keymap_layer_active_with_state(uint8_t layer, zmk_keymap_layers_state_t state_to_test) {
+bool zmk_keymap_layer_active_with_state(uint8_t layer,
+                                        const zmk_keymap_layers_state_t *state_to_test) {
     // The default layer is assumed to be ALWAYS ACTIVE so we include an || here to ensure nobody
     // breaks up that assumption by accident
-    return (state_to_test & (BIT(layer))) == (BIT(layer)) || layer == _zmk_keymap_layer_default;
+    return zmk_keymap_layers_state_test(state_to_test, layer) || layer == _zmk_keymap_layer_default;
 };
 
 bool zmk_keymap_layer_active(uint8_t layer) {
-    return zmk_keymap_layer_active_with_state(layer, _zmk_keymap_layer_state);
+    return zmk_keymap_layer_active_with_state(layer, &_zmk_keymap_layer_state);
 };
 
 uint8_t zmk_keymap_highest_layer_active() {
-    for (uint8_t layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer > 0; layer--) {
-        if (zmk_keymap_layer_active(layer)) {
-            return layer;
-        }
-    }
-    return zmk_keymap_layer_default();
+    return MAX(zmk_keymap_layers_state_highest(&_zmk_keymap_layer_state),
+               _zmk_keymap_layer_default);
 }
 
 int zmk_keymap_layer_activate(uint8_t layer) { return set_layer_state(layer, true); };
@@ -137,17 +258,37 @@ int zmk_keymap_layer_toggle(uint8_t layer) {
 };
 
 int zmk_keymap_layer_to(uint8_t layer) {
-    for (int i = ZMK_KEYMAP_LAYERS_LEN - 1; i >= 0; i--) {
-        zmk_keymap_layer_deactivate(i);
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
+        return -EINVAL;
+    }
+
+    // Deactivate every layer but the default one, which can't be, and activate the target layer
+    // in a single transition.
+    zmk_keymap_layers_state_t new_state = {0};
+    zmk_keymap_layers_state_write(
+        &new_state, _zmk_keymap_layer_default,
+        zmk_keymap_layers_state_test(&_zmk_keymap_layer_state, _zmk_keymap_layer_default));
+    zmk_keymap_layers_state_write(&new_state, layer, true);
+
+    if (zmk_keymap_layers_state_equal(&new_state, &_zmk_keymap_layer_state)) {
+        return 0;
     }
 
-    zmk_keymap_layer_activate(layer);
+    _zmk_keymap_layer_state = new_state;
+
+    LOG_DBG("layer_changed: to layer %d", layer);
+    for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        zmk_keymap_effective_layer[position] =
+            find_effective_layer(position, ZMK_KEYMAP_LAYERS_LEN - 1);
+    }
+    // A single event for the whole transition; listeners read the new state from the keymap
+    ZMK_EVENT_RAISE(create_layer_state_changed(layer, true));
 
     return 0;
 }
 
-bool is_active_layer(uint8_t layer, zmk_keymap_layers_state_t layer_state) {
-    return (layer_state & BIT(layer)) == BIT(layer) || layer == _zmk_keymap_layer_default;
+bool is_active_layer(uint8_t layer, const zmk_keymap_layers_state_t *layer_state) {
+    return zmk_keymap_layers_state_test(layer_state, layer) || layer == _zmk_keymap_layer_default;
 }
 
 const char *zmk_keymap_layer_label(uint8_t layer) {
@@ -171,7 +312,7 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
                                     int64_t timestamp) {
     // We want to make a copy of this, since it may be converted from
     // relative to absolute before being invoked
-    struct zmk_behavior_binding binding = zmk_keymap[layer][position];
+    struct zmk_behavior_binding binding;
     const struct device *behavior;
     struct zmk_behavior_binding_event event = {
         .layer = layer,
@@ -179,10 +320,12 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
         .timestamp = timestamp,
     };
 
+    decode_entry(&zmk_keymap[layer][position], &binding);
+
     LOG_DBG("layer: %d position: %d, binding name: %s", layer, position,
             log_strdup(binding.behavior_dev));
 
-    behavior = device_get_binding(binding.behavior_dev);
+    behavior = binding.behavior;
 
     if (!behavior) {
         LOG_WRN("No behavior assigned to %d on layer %d", position, layer);
@@ -232,8 +375,18 @@ int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pr
     if (pressed) {
         zmk_keymap_active_behavior_layer[position] = _zmk_keymap_layer_state;
     }
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
-        if (zmk_keymap_layer_active_with_state(layer, zmk_keymap_active_behavior_layer[position])) {
+
+    // Layers above the effective layer are inactive or transparent in the current layer state,
+    // so skip them unless this is the release of a key pressed under a different layer state.
+    int top = ZMK_KEYMAP_LAYERS_LEN - 1;
+    if (zmk_keymap_layers_state_equal(&zmk_keymap_active_behavior_layer[position],
+                                      &_zmk_keymap_layer_state)) {
+        top = zmk_keymap_effective_layer[position];
+    }
+
+    for (int layer = top; layer >= _zmk_keymap_layer_default; layer--) {
+        if (zmk_keymap_layer_active_with_state(layer,
+                                               &zmk_keymap_active_behavior_layer[position])) {
             int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
             if (ret > 0) {
                 LOG_DBG("behavior processing to continue to next layer");
@@ -255,21 +408,20 @@ int zmk_keymap_sensor_triggered(uint8_t sensor_number, const struct device *sens
                                 int64_t timestamp) {
     for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
         if (zmk_keymap_layer_active(layer) && zmk_sensor_keymap[layer] != NULL) {
-            struct zmk_behavior_binding *binding = &zmk_sensor_keymap[layer][sensor_number];
-            const struct device *behavior;
+            struct zmk_behavior_binding binding;
             int ret;
 
-            LOG_DBG("layer: %d sensor_number: %d, binding name: %s", layer, sensor_number,
-                    log_strdup(binding->behavior_dev));
+            decode_entry(&zmk_sensor_keymap[layer][sensor_number], &binding);
 
-            behavior = device_get_binding(binding->behavior_dev);
+            LOG_DBG("layer: %d sensor_number: %d, binding name: %s", layer, sensor_number,
+                    log_strdup(binding.behavior_dev));
 
-            if (!behavior) {
+            if (!binding.behavior) {
                 LOG_DBG("No behavior assigned to %d on layer %d", sensor_number, layer);
                 continue;
             }
 
-            ret = behavior_sensor_keymap_binding_triggered(binding, sensor, timestamp);
+            ret = behavior_sensor_keymap_binding_triggered(&binding, sensor, timestamp);
 
             if (ret > 0) {
                 LOG_DBG("behavior processing to continue to next layer");
@@ -291,8 +443,16 @@ int zmk_keymap_sensor_triggered(uint8_t sensor_number, const struct device *sens
 int keymap_listener(const zmk_event_t *eh) {
     const struct zmk_position_state_changed *pos_ev;
     if ((pos_ev = as_zmk_position_state_changed(eh)) != NULL) {
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+        zmk_latency_begin(pos_ev->source, pos_ev->scan_cycles);
+        int ret = zmk_keymap_position_state_changed(pos_ev->source, pos_ev->position,
+                                                    pos_ev->state, pos_ev->timestamp);
+        zmk_latency_end();
+        return ret;
+#else
         return zmk_keymap_position_state_changed(pos_ev->source, pos_ev->position, pos_ev->state,
                                                  pos_ev->timestamp);
+#endif
     }
 
 #if ZMK_KEYMAP_HAS_SENSORS
@@ -306,6 +466,127 @@ int keymap_listener(const zmk_event_t *eh) {
     return -ENOTSUP;
 }
 
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_BENCHMARK)
+#include <zmk/benchmark.h>
+
+// Applies a binding the way the keymap did before bindings carried their device: the keymap and
+// each behavior API wrapper it calls looked the behavior up by name.
+static int benchmark_apply_by_name(int layer, uint32_t position, bool pressed) {
+    struct zmk_behavior_binding binding;
+    struct zmk_behavior_binding_event event = {
+        .layer = layer,
+        .position = position,
+        .timestamp = 0,
+    };
+
+    decode_entry(&zmk_keymap[layer][position], &binding);
+
+    const struct device *behavior = device_get_binding(binding.behavior_dev);
+    if (!behavior) {
+        return 1;
+    }
+
+    binding.behavior = NULL;
+    int err = behavior_keymap_binding_convert_central_state_dependent_params(&binding, event);
+    if (err) {
+        return err;
+    }
+
+    enum behavior_locality locality = BEHAVIOR_LOCALITY_CENTRAL;
+    err = behavior_get_locality(behavior, &locality);
+    if (err) {
+        return err;
+    }
+
+    binding.behavior = NULL;
+    return invoke_locally(&binding, event, pressed);
+}
+
+// Checks that every binding resolved to the device its name looks up, then times pressing and
+// releasing a &none binding on the default layer by name and through the resolved device.
+static void keymap_benchmark(void) {
+    int bindings = 0;
+    int none_position = -1;
+
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+            struct zmk_behavior_binding binding;
+            decode_entry(&zmk_keymap[layer][position], &binding);
+
+            if (binding.behavior != device_get_binding(binding.behavior_dev)) {
+                LOG_ERR("keymap benchmark: layer %d position %d resolved to a different device "
+                        "than %s",
+                        layer, position, log_strdup(binding.behavior_dev));
+                return;
+            }
+            bindings++;
+
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_none)
+            if (layer == _zmk_keymap_layer_default && none_position < 0 &&
+                binding.behavior == DEVICE_DT_GET(DT_INST(0, zmk_behavior_none))) {
+                none_position = position;
+            }
+#endif
+        }
+    }
+
+    if (none_position < 0) {
+        LOG_WRN("keymap benchmark: no &none binding on the default layer to time");
+        return;
+    }
+
+    uint32_t start = zmk_benchmark_start();
+    for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+        benchmark_apply_by_name(_zmk_keymap_layer_default, none_position, true);
+        benchmark_apply_by_name(_zmk_keymap_layer_default, none_position, false);
+    }
+    const uint32_t by_name_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+
+    start = zmk_benchmark_start();
+    for (int i = 0; i < ZMK_BENCHMARK_ROUNDS; i++) {
+        zmk_keymap_apply_position_state(ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
+                                        _zmk_keymap_layer_default, none_position, true, 0);
+        zmk_keymap_apply_position_state(ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
+                                        _zmk_keymap_layer_default, none_position, false, 0);
+    }
+    const uint32_t resolved_ns = zmk_benchmark_ns(start, ZMK_BENCHMARK_ROUNDS);
+
+    // Logged last, since the timed calls log every binding they apply.
+    LOG_INF("keymap benchmark: press and release by name %u ns, resolved %u ns", by_name_ns,
+            resolved_ns);
+    LOG_INF("keymap benchmark: %d bindings resolved to the device their name looks up", bindings);
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_BENCHMARK) */
+
+static int zmk_keymap_init(const struct device *_arg) {
+    // Resolve every binding's behavior device up front, once all behaviors are initialized, so
+    // that key presses never need to look devices up by name.
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+            resolve_entry(&zmk_keymap[layer][position]);
+        }
+#if ZMK_KEYMAP_HAS_SENSORS
+        for (int sensor = 0; sensor < ZMK_KEYMAP_SENSORS_LEN; sensor++) {
+            resolve_entry(&zmk_sensor_keymap[layer][sensor]);
+        }
+#endif /* ZMK_KEYMAP_HAS_SENSORS */
+    }
+
+    for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        zmk_keymap_effective_layer[position] =
+            find_effective_layer(position, ZMK_KEYMAP_LAYERS_LEN - 1);
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_BENCHMARK)
+    keymap_benchmark();
+#endif
+
+    return 0;
+}
+
+SYS_INIT(zmk_keymap_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 ZMK_LISTENER(keymap, keymap_listener);
 ZMK_SUBSCRIPTION(keymap, zmk_position_state_changed);
 
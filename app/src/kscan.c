@@ -12,49 +12,133 @@
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+#include <zmk/kscan.h>
+#include <zmk/deadline.h>
+#include <zmk/matrix.h>
 #include <zmk/matrix_transform.h>
+#include <zmk/workqueue.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 
-#define ZMK_KSCAN_EVENT_STATE_PRESSED 0
-#define ZMK_KSCAN_EVENT_STATE_RELEASED 1
+#define ZMK_KSCAN_POSITION_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)
 
+/*
+ * One or more key position changes found by the same scan. Changes reported outside of a batch
+ * each get their own event.
+ */
 struct zmk_kscan_event {
-    uint32_t row;
-    uint32_t column;
-    uint32_t state;
+    int64_t timestamp;
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+    uint32_t scan_cycles;
+#endif
+    // Bit vector of the positions which changed
+    uint32_t changed[ZMK_KSCAN_POSITION_WORDS];
+    // Bit vector of the new state of each changed position
+    uint32_t pressed[ZMK_KSCAN_POSITION_WORDS];
 };
 
 struct zmk_kscan_msg_processor {
     struct k_work work;
 } msg_processor;
 
-K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, 4);
+K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, 8);
+
+static bool batching;
+static struct zmk_kscan_event batch;
+static atomic_t dropped_events;
+
+uint32_t zmk_kscan_get_dropped_events(void) { return atomic_get(&dropped_events); }
+
+static void zmk_kscan_queue_event(const struct zmk_kscan_event *ev) {
+    if (k_msgq_put(&zmk_kscan_msgq, ev, K_NO_WAIT) != 0) {
+        atomic_inc(&dropped_events);
+        for (int i = 0; i < ZMK_KSCAN_POSITION_WORDS; i++) {
+            for (uint32_t changed = ev->changed[i]; changed; changed &= changed - 1) {
+                const int bit = __builtin_ctz(changed);
+                LOG_WRN("kscan event queue is full. Dropped position %d, pressed %s (%d dropped)",
+                        i * 32 + bit, ((ev->pressed[i] & BIT(bit)) ? "true" : "false"),
+                        atomic_get(&dropped_events));
+            }
+        }
+    }
+
+    k_work_submit_to_queue(zmk_input_work_q(), &msg_processor.work);
+}
+
+void zmk_kscan_begin_batch(int64_t timestamp) {
+    batching = true;
+    batch.timestamp = timestamp;
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+    batch.scan_cycles = k_cycle_get_32();
+#endif
+}
+
+void zmk_kscan_end_batch(void) {
+    batching = false;
+
+    for (int i = 0; i < ZMK_KSCAN_POSITION_WORDS; i++) {
+        if (batch.changed[i]) {
+            zmk_kscan_queue_event(&batch);
+            memset(batch.changed, 0, sizeof(batch.changed));
+            memset(batch.pressed, 0, sizeof(batch.pressed));
+            return;
+        }
+    }
+}
 
 static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t column,
                                bool pressed) {
-    struct zmk_kscan_event ev = {
-        .row = row,
-        .column = column,
-        .state = (pressed ? ZMK_KSCAN_EVENT_STATE_PRESSED : ZMK_KSCAN_EVENT_STATE_RELEASED)};
+    uint32_t position = zmk_matrix_transform_row_column_to_position(row, column);
 
-    k_msgq_put(&zmk_kscan_msgq, &ev, K_NO_WAIT);
-    k_work_submit(&msg_processor.work);
+    if (position >= ZMK_KEYMAP_LEN) {
+        LOG_WRN("Ignoring change at row %d, col %d with no key position", row, column);
+        return;
+    }
+
+    if (batching) {
+        WRITE_BIT(batch.changed[position / 32], position % 32, true);
+        WRITE_BIT(batch.pressed[position / 32], position % 32, pressed);
+        return;
+    }
+
+    struct zmk_kscan_event ev = {.timestamp = zmk_deadline_now()};
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+    ev.scan_cycles = k_cycle_get_32();
+#endif
+    WRITE_BIT(ev.changed[position / 32], position % 32, true);
+    WRITE_BIT(ev.pressed[position / 32], position % 32, pressed);
+
+    zmk_kscan_queue_event(&ev);
 }
 
 void zmk_kscan_process_msgq(struct k_work *item) {
     struct zmk_kscan_event ev;
 
     while (k_msgq_get(&zmk_kscan_msgq, &ev, K_NO_WAIT) == 0) {
-        bool pressed = (ev.state == ZMK_KSCAN_EVENT_STATE_PRESSED);
-        uint32_t position = zmk_matrix_transform_row_column_to_position(ev.row, ev.column);
-        LOG_DBG("Row: %d, col: %d, position: %d, pressed: %s", ev.row, ev.column, position,
-                (pressed ? "true" : "false"));
-        ZMK_EVENT_RAISE(new_zmk_position_state_changed(
-            (struct zmk_position_state_changed){.source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
-                                                .state = pressed,
-                                                .position = position,
-                                                .timestamp = k_uptime_get()}));
+        // Raise the changes in position order, all with the timestamp of the scan.
+        for (int i = 0; i < ZMK_KSCAN_POSITION_WORDS; i++) {
+            uint32_t changed = ev.changed[i];
+
+            while (changed) {
+                const int bit = __builtin_ctz(changed);
+                const uint32_t position = i * 32 + bit;
+                const bool pressed = (ev.pressed[i] & BIT(bit)) != 0;
+
+                LOG_DBG("Position: %d, pressed: %s, delay: %lld ms", position,
+                        (pressed ? "true" : "false"), zmk_deadline_now() - ev.timestamp);
+                struct zmk_position_state_changed data = {
+                    .source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
+                    .state = pressed,
+                    .position = position,
+                    .timestamp = ev.timestamp};
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+                data.scan_cycles = ev.scan_cycles;
+#endif
+                ZMK_EVENT_RAISE(new_zmk_position_state_changed(data));
+
+                changed &= changed - 1;
+            }
+        }
     }
 }
 
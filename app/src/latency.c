@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/latency.h>
+#include <zmk/events/position_state_changed.h>
+
+#define BUCKET_WIDTH_US CONFIG_ZMK_LATENCY_STATS_BUCKET_WIDTH_US
+#define BUCKET_COUNT CONFIG_ZMK_LATENCY_STATS_BUCKET_COUNT
+
+struct latency_histogram {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    // The last bucket also counts every latency beyond the histogram range
+    uint32_t buckets[BUCKET_COUNT];
+};
+
+static const char *endpoint_names[] = {"usb", "ble"};
+static const char *source_names[] = {"local", "peripheral"};
+
+static struct latency_histogram histograms[ZMK_LATENCY_ENDPOINT_COUNT][ZMK_LATENCY_SOURCE_COUNT];
+
+struct latency_start {
+    enum zmk_latency_source source;
+    uint32_t scan_cycles;
+};
+
+// The key position change being processed, and the oldest one whose report was deferred
+static bool pending;
+static struct latency_start pending_start;
+static bool deferred;
+static struct latency_start deferred_start;
+
+void zmk_latency_begin(uint8_t position_source, uint32_t scan_cycles) {
+    pending = true;
+    pending_start.source = position_source == ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL
+                               ? ZMK_LATENCY_SOURCE_LOCAL
+                               : ZMK_LATENCY_SOURCE_PERIPHERAL;
+    pending_start.scan_cycles = scan_cycles;
+}
+
+void zmk_latency_end(void) { pending = false; }
+
+void zmk_latency_defer(void) {
+    if (pending && !deferred) {
+        deferred = true;
+        deferred_start = pending_start;
+    }
+    pending = false;
+}
+
+void zmk_latency_end_deferred(void) { deferred = false; }
+
+void zmk_latency_record(enum zmk_endpoint endpoint) {
+    if (endpoint >= ZMK_LATENCY_ENDPOINT_COUNT) {
+        return;
+    }
+
+    // Only the first report caused by a key position change measures its latency. A deferred
+    // change is older than the current one, so a report sent now carries it first.
+    struct latency_start start;
+    if (deferred) {
+        deferred = false;
+        start = deferred_start;
+    } else if (pending) {
+        pending = false;
+        start = pending_start;
+    } else {
+        return;
+    }
+
+    uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - start.scan_cycles);
+    LOG_DBG("%s/%s latency %d us", endpoint_names[endpoint], source_names[start.source],
+            latency_us);
+    struct latency_histogram *histogram = &histograms[endpoint][start.source];
+
+    if (histogram->count == 0 || latency_us < histogram->min_us) {
+        histogram->min_us = latency_us;
+    }
+    if (latency_us > histogram->max_us) {
+        histogram->max_us = latency_us;
+    }
+    histogram->count++;
+    histogram->total_us += latency_us;
+    histogram->buckets[MIN(latency_us / BUCKET_WIDTH_US, BUCKET_COUNT - 1)]++;
+}
+
+int zmk_latency_get_stats(enum zmk_endpoint endpoint, enum zmk_latency_source source,
+                          struct zmk_latency_stats *stats) {
+    if (endpoint >= ZMK_LATENCY_ENDPOINT_COUNT || source >= ZMK_LATENCY_SOURCE_COUNT) {
+        return -EINVAL;
+    }
+
+    const struct latency_histogram *histogram = &histograms[endpoint][source];
+
+    *stats = (struct zmk_latency_stats){.count = histogram->count};
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    stats->min_us = histogram->min_us;
+    stats->max_us = histogram->max_us;
+    stats->avg_us = histogram->total_us / histogram->count;
+
+    uint32_t p99_count = DIV_ROUND_UP(histogram->count * 99, 100);
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= p99_count) {
+            stats->p99_us = MIN((i + 1) * BUCKET_WIDTH_US, histogram->max_us);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void zmk_latency_reset(void) { memset(histograms, 0, sizeof(histograms)); }
+
+void zmk_latency_log(void) {
+    for (int endpoint = 0; endpoint < ZMK_LATENCY_ENDPOINT_COUNT; endpoint++) {
+        for (int source = 0; source < ZMK_LATENCY_SOURCE_COUNT; source++) {
+            struct zmk_latency_stats stats;
+            zmk_latency_get_stats(endpoint, source, &stats);
+            if (stats.count == 0) {
+                continue;
+            }
+
+            LOG_INF("%s/%s: %d reports, min %d avg %d p99 %d max %d us", endpoint_names[endpoint],
+                    source_names[source], stats.count, stats.min_us, stats.avg_us, stats.p99_us,
+                    stats.max_us);
+        }
+    }
+}
+
+#if IS_ENABLED(CONFIG_SHELL)
+#include <shell/shell.h>
+
+static int cmd_latency_show(const struct shell *shell, size_t argc, char **argv) {
+    for (int endpoint = 0; endpoint < ZMK_LATENCY_ENDPOINT_COUNT; endpoint++) {
+        for (int source = 0; source < ZMK_LATENCY_SOURCE_COUNT; source++) {
+            struct zmk_latency_stats stats;
+            zmk_latency_get_stats(endpoint, source, &stats);
+
+            shell_print(shell, "%s/%s: %d reports, min %d avg %d p99 %d max %d us",
+                        endpoint_names[endpoint], source_names[source], stats.count, stats.min_us,
+                        stats.avg_us, stats.p99_us, stats.max_us);
+        }
+    }
+
+    return 0;
+}
+
+static int cmd_latency_reset(const struct shell *shell, size_t argc, char **argv) {
+    zmk_latency_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_latency, SHELL_CMD(show, NULL, "Print key latency statistics", cmd_latency_show),
+    SHELL_CMD(reset, NULL, "Reset key latency statistics", cmd_latency_reset),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(latency, &sub_latency, "ZMK scan to report latency", NULL);
+#endif
@@ -25,6 +25,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/battery_state_changed.h>
+#include <zmk/workqueue.h>
 #include <init.h>
 
 static int start_scan(void);
@@ -117,9 +118,12 @@ int release_peripheral_slot(int index) {
                                                         .position = position,
                                                         .state = false,
                                                         .timestamp = k_uptime_get()};
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+                ev.scan_cycles = k_cycle_get_32();
+#endif
 
                 k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT);
-                k_work_submit(&peripheral_event_work);
+                k_work_submit_to_queue(zmk_input_work_q(), &peripheral_event_work);
             }
         }
     }
@@ -202,9 +206,12 @@ static uint8_t split_central_notify_func(struct bt_conn *conn,
                                                         .position = position,
                                                         .state = pressed,
                                                         .timestamp = k_uptime_get()};
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_STATS)
+                ev.scan_cycles = k_cycle_get_32();
+#endif
 
                 k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT);
-                k_work_submit(&peripheral_event_work);
+                k_work_submit_to_queue(zmk_input_work_q(), &peripheral_event_work);
             }
         }
     }
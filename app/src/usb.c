@@ -16,6 +16,7 @@
 #include <zmk/events/usb_conn_state_changed.h>
 
 #include <zmk/usb_hid.h>
+#include <zmk/workqueue.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -62,7 +63,7 @@ void usb_status_cb(enum usb_dc_status_code status, const uint8_t *params) {
     }
 #endif
     usb_status = status;
-    k_work_submit(&usb_status_notifier_work);
+    k_work_submit_to_queue(zmk_input_work_q(), &usb_status_notifier_work);
 };
 
 static int zmk_usb_init(const struct device *_arg) {
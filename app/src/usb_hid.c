@@ -139,6 +139,16 @@ static int zmk_usb_hid_send_report(const uint8_t *report, size_t len) {
     }
 }
 
+bool zmk_usb_hid_keyboard_report_is_dirty() {
+#if IS_ENABLED(CONFIG_ZMK_USB_BOOT)
+    if (hid_protocol == HID_PROTOCOL_BOOT) {
+        return zmk_hid_boot_report_is_dirty();
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_USB_BOOT) */
+
+    return zmk_hid_keyboard_report_is_dirty();
+}
+
 int zmk_usb_hid_send_keyboard_report() {
     size_t len;
     uint8_t *report = get_keyboard_report(&len);